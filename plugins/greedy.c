@@ -0,0 +1,29 @@
+// A sample controller plugin for snek, which heads straight for the food without running into anything.
+// Build with: gcc -shared -fPIC -I. -o greedy.so plugins/greedy.c
+// Run with: ./snek --plugin greedy.so
+#include <stdlib.h>
+
+#include "snek_plugin.h"
+
+// Take the step that gets closest to the food without running into a wall or the snek entity, otherwise keep going.
+int32_t snek_plugin_direction(const struct snek_plugin_board* board) {
+    int32_t row_steps[4] = {-1, 1, 0, 0};
+    int32_t column_steps[4] = {0, 0, -1, 1};
+    int32_t best_direction = board->direction;
+    int32_t best_distance = board->rows + board->columns;
+
+    for (int32_t i = 0; i < 4; i++) {
+        int32_t row = board->head_row + row_steps[i];
+        int32_t column = board->head_column + column_steps[i];
+        int32_t tile = board->map[row * board->columns + column];
+        if (i == (board->direction ^ 1) || (tile != SNEK_PLUGIN_BLACK && tile != SNEK_PLUGIN_RED)) {
+            continue;
+        }
+        int32_t distance = abs(row - board->food_row) + abs(column - board->food_column);
+        if (distance < best_distance) {
+            best_distance = distance;
+            best_direction = i;
+        }
+    }
+    return best_direction;
+}
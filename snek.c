@@ -5,7 +5,21 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <errno.h>
+#include <stdatomic.h>
+#include <string.h>
 #include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sched.h>
+
+// Process and shared memory control are only used natively, for control channels with bots in other processes, and so is loading plugins.
+#ifndef __EMSCRIPTEN__
+    #include <sys/wait.h>
+    #include <dlfcn.h>
+#endif
 
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_ttf.h>
@@ -14,6 +28,15 @@
     #include <emscripten/emscripten.h> 
 #endif
 
+// Include the font compiled into the program if it has been generated.
+// This is generated with: xxd -i third_party/roboto_mono/RobotoMono-Bold.ttf > snek_font.h
+#ifdef SNEK_EMBEDDED_FONT
+    #include "snek_font.h"
+#endif
+
+// Include the interface for controller plugins.
+#include "snek_plugin.h"
+
 // Define screen related constants.
 // This will be based around trying to have cells that are close to a square as possible.
 // This is based on a 16:9 display aspect ratio and settings.
@@ -22,6 +45,17 @@
 #define MAP_ROWS 30
 #define MAP_COLUMNS 53
 
+// Define level constants:
+// Level files start with this magic and version, and each section starts on this alignment so it can be used straight from the mapped file.
+#define LEVEL_MAGIC "SNEKLVL1"
+#define LEVEL_VERSION 1
+#define LEVEL_ALIGNMENT 8
+
+// Define font constants:
+// The font is looked for relative to the program first, then the working directory, unless it is compiled into the program.
+#define FONT_PATH "third_party/roboto_mono/RobotoMono-Bold.ttf"
+#define FONT_SIZE 24
+
 // Define program status constants:
 #define START_MENU 0
 #define MID_GAME 1
@@ -41,6 +75,28 @@
 #define RED 2
 #define GREY 3
 #define HEAD 4
+#define TILE_COLOURS 5
+
+// Plugins are shown the same directions and tiles as the game uses.
+_Static_assert(UP == SNEK_PLUGIN_UP && DOWN == SNEK_PLUGIN_DOWN && LEFT == SNEK_PLUGIN_LEFT && RIGHT == SNEK_PLUGIN_RIGHT, "Plugin directions must match the game's.");
+_Static_assert(BLACK == SNEK_PLUGIN_BLACK && GREEN == SNEK_PLUGIN_GREEN && RED == SNEK_PLUGIN_RED && GREY == SNEK_PLUGIN_GREY && HEAD == SNEK_PLUGIN_HEAD, "Plugin tiles must match the game's.");
+
+// Define the red, green and blue of each tile colour label, in the same order as the labels.
+const uint8_t snek_tile_colours[TILE_COLOURS][3] = {
+    {0, 0, 0},
+    {0, 200, 60},
+    {255, 0, 0},
+    {32, 32, 32},
+    {0, 200, 20},
+};
+
+// Define constants for retained user interface screens:
+// Each is composed once into a cached texture and copied to the display until something on it changes.
+#define SCREEN_MENU 0
+#define SCREEN_GAME_OVER 1
+#define SCREEN_PAUSE 2
+#define SCREEN_COUNT 3
+#define SCREEN_NONE -1
 
 // Define constants for difficulty:
 // This is equivalent to the milliseconds between updates.
@@ -48,6 +104,78 @@
 #define REGULAR 50 
 #define HARD 30
 
+// Define the most updates that can be run in a single loop pass to catch up after falling behind.
+// Any further time owed is dropped, so a long stall does not fast forward the game.
+#define MAX_CATCH_UP_UPDATES 5
+
+// Define constants for input latency measurement:
+// Histogram buckets are one millisecond wide, with the last bucket holding every slower sample.
+// Pending inputs beyond the maximum in a single tick are still applied, just not measured.
+#define LATENCY_BUCKETS 128
+#define LATENCY_PENDING_MAX 16
+
+// Define constants for the fuzzing harness:
+// Games are cut off after the maximum ticks, and inputs that are not a direction mean no keypress that tick.
+#define FUZZ_MAX_TICKS 65536
+#define FUZZ_NO_INPUT 4
+
+// Define constants for the autopilot planner:
+// Each rollout plays this many ticks ahead, and planning for a tick stops after this percentage of the difficulty's delay.
+// Without worker threads, a plan that must not block only gets the quick rollouts.
+#define PLANNER_MAX_THREADS 64
+#define PLANNER_ROLLOUT_DEPTH 64
+#define PLANNER_BUDGET_PERCENT 75
+#define PLANNER_QUICK_ROLLOUTS 64
+
+// Define constants for the transposition table:
+// It has two to the power of this many entries, and cached rollout counts are capped so that new rollouts still matter.
+#define TRANSPOSITION_TABLE_BITS 18
+#define TRANSPOSITION_MAX_ROLLOUTS 65536
+
+// Define constants for the spectator wall:
+// Every board is drawn one pixel per tile into a single streaming texture, which is scaled to the window.
+#define SPECTATOR_DEFAULT_BOARDS 256
+#define SPECTATOR_MAX_BOARDS 4096
+
+// Define constants for trajectory datasets:
+// Rows are buffered into chunks of this many ticks, and each column of a chunk starts on the alignment so it can be used straight from a mapped file.
+// The columns are the game, tick, direction, head row and column, food row and column, score and the packed tile map.
+// Recorded games are cut off after the maximum ticks.
+#define TRAJECTORY_MAGIC "SNEKTRJ1"
+#define TRAJECTORY_VERSION 1
+#define TRAJECTORY_CHUNK_ROWS 16384
+#define TRAJECTORY_ALIGNMENT 8
+#define TRAJECTORY_COLUMNS 9
+#define TRAJECTORY_MAP_COLUMN 8
+#define TRAJECTORY_MAP_SIZE ((MAP_ROWS * MAP_COLUMNS + 1) / 2)
+#define TRAJECTORY_MAX_TICKS 65536
+
+// Define flags for trajectory datasets:
+#define TRAJECTORY_MAP 1
+#define TRAJECTORY_COMPRESSED 2
+
+// Define constants for the shared memory control channel:
+// The bot's direction slot is kept on its own cache line, away from the board the game writes every tick.
+#define CHANNEL_MAGIC "SNEKCHN1"
+#define CHANNEL_VERSION 1
+#define CHANNEL_CACHE_LINE 64
+#define CHANNEL_BENCH_TICKS 100000
+#define CHANNEL_SPIN_LIMIT 100
+
+// Define constants for controller plugins:
+// Plugins must decide within this percentage of the delay between updates, and latency percentiles are taken over this many recent decisions.
+#define PLUGIN_BUDGET_PERCENT 75
+#define PLUGIN_LATENCY_SAMPLES 65536
+
+// Define constants for memory use in the steady state:
+// The entity pool holds every node of the longest possible snek entity twice over, as snek_update() builds the new snek entity before freeing the old one.
+// Glyphs are cached for every printable character, and allocations are counted for each program status.
+#define ENTITY_POOL_SIZE (2 * MAP_ROWS * MAP_COLUMNS + 2)
+#define GLYPH_FIRST 32
+#define GLYPH_COUNT 95
+#define STATUS_COUNT 5
+#define ALLOCATION_TEST_TICKS 1000000
+
 // Create a linked list data type to represent the snek entity.
 struct snek_entity {
     int32_t row;
@@ -56,6 +184,24 @@ struct snek_entity {
     struct snek_entity* next;
 };
 
+// Create a data type to track input to photon latency for a single game.
+// Timestamps are in SDL milliseconds, the same clock as SDL event timestamps.
+// An input is pending until the tick that applies it, then applied until the present that first shows it.
+struct snek_latency {
+    uint32_t pending_input_time[LATENCY_PENDING_MAX];
+    int32_t pending_count;
+
+    uint32_t applied_input_time[LATENCY_PENDING_MAX];
+    uint32_t applied_tick_time;
+    int32_t applied_count;
+
+    // Histograms of each stage, and the total number of samples recorded in each.
+    uint32_t input_to_tick[LATENCY_BUCKETS];
+    uint32_t tick_to_photon[LATENCY_BUCKETS];
+    uint32_t input_to_photon[LATENCY_BUCKETS];
+    uint32_t samples;
+};
+
 // Create a global data type to hold all associated data with the program.
 struct snek {
     // SDL data:
@@ -71,6 +217,23 @@ struct snek {
     int32_t food_row;
     int32_t food_column;
 
+    // Random number generator state used to spawn food.
+    // Games replay exactly from the same seed and inputs.
+    uint64_t random_state;
+
+    // Zobrist hash of the game state, updated by snek_update() as the head, tail, direction and food change.
+    // The zobrist direction is the direction currently mixed into the hash.
+    uint64_t zobrist;
+    int32_t zobrist_direction;
+
+    // Positions of the head and tail before and after the last update, used to interpolate rendering between updates.
+    int32_t previous_head_row;
+    int32_t previous_head_column;
+    int32_t previous_tail_row;
+    int32_t previous_tail_column;
+    int32_t tail_row;
+    int32_t tail_column;
+
     // Tile Map data:
     int32_t map[MAP_ROWS][MAP_COLUMNS];
 
@@ -78,26 +241,471 @@ struct snek {
     int32_t status;
 
     // Set timer storage:
-    int32_t current_time;
-    int32_t last_time;
+    // These are in performance counter units.
+    // The accumulator stores the time elapsed that is still owed to updates.
+    uint64_t current_time;
+    uint64_t last_time;
+    uint64_t accumulator;
+
+    // Tick rate measurement for the current game:
+    // Game time excludes time spent paused.
+    uint64_t game_time;
+    uint64_t ticks;
+    uint64_t ticks_dropped;
 
     // Font data:
+    // The font is loaded the first time text is rendered. If it fails, it is not tried again.
     TTF_Font* font;
+    bool font_failed;
+
+    // Retained user interface data:
+    // Each screen is composed once into a cached texture, and only composed again once marked dirty.
+    // The screen shown is the cached screen currently on the display, or none if anything else is.
+    // If the renderer can't render to textures, screens are drawn directly every loop pass instead.
+    SDL_Texture* screens[SCREEN_COUNT];
+    bool screen_dirty[SCREEN_COUNT];
+    int32_t screen_shown;
+    bool screen_targets_failed;
+
+    // The interpolation of the last frame of gameplay, to draw it again under the pause screen.
+    float interpolation;
+
+    // Startup timing:
+    // Time to first frame is measured from the launch time, and printed once the first frame is presented.
+    uint64_t launch_time;
+    bool first_frame_presented;
 
     // Difficulty:
     int32_t difficulty;
+
+    // Input latency data:
+    // When late latch is set, input is only sampled right before each update instead of every loop pass.
+    struct snek_latency latency;
+    bool late_latch;
+
+    // Autopilot data:
+    // When autopilot is set, the planner chooses the direction every update instead of the player.
+    struct snek_planner* planner;
+    bool autopilot;
+
+    // Spectator wall data, when spectating bots instead of playing.
+    struct snek_spectator* spectator;
+
+    // Shared memory control channel, when bot processes are playing instead of the player.
+    struct snek_channel* channel;
+    const char* channel_name;
+
+    // Controller plugin, when a plugin is playing instead of the player.
+    struct snek_plugin* plugin;
+
+    // A texture and width for every printable character, rendered once when the font is loaded so drawing text does not allocate.
+    SDL_Texture* glyphs[GLYPH_COUNT];
+    int32_t glyph_widths[GLYPH_COUNT];
+    bool glyphs_ready;
+};
+
+// Create a data type for a pool of snek entity nodes, so the snek entity never allocates once the game is running.
+// Free nodes are kept in a linked list through their next pointers, and nodes allocated on the heap because the pool ran out are counted.
+struct snek_entity_pool {
+    struct snek_entity nodes[ENTITY_POOL_SIZE];
+    struct snek_entity* free_list;
+    uint64_t fallbacks;
+};
+
+// Create a data type for counting heap allocations made while the program is in each status.
+// The status is set as the main loop moves between statuses, and allocations made on any thread count towards it.
+struct snek_allocations {
+    _Atomic uint64_t count[STATUS_COUNT];
+    _Atomic int32_t status;
+};
+
+// Create a data type for the board published to bot processes every tick.
+struct snek_channel_board {
+    uint64_t tick;
+    int32_t status;
+    int32_t direction;
+    int32_t score;
+    int32_t head_row;
+    int32_t head_column;
+    int32_t food_row;
+    int32_t food_column;
+    int32_t map[MAP_ROWS][MAP_COLUMNS];
+};
+
+// Create a data type for a controller plugin loaded from a shared object, and the thread it decides on.
+// The plugin is shown a snapshot of the board every tick, and the host only waits for it until a deadline, so a slow plugin never holds up the game.
+// While the plugin is still deciding an earlier tick, later ticks are missed instead of waiting for it.
+struct snek_plugin {
+    const char* path;
+    void* library;
+    snek_plugin_direction_function direction;
+
+    SDL_Thread* thread;
+    SDL_mutex* mutex;
+    SDL_cond* start_condition;
+    SDL_cond* done_condition;
+    bool quit;
+    bool busy;
+
+    // Each tick's request is numbered, and the answer records which request it was for and how long after the request it came.
+    uint64_t generation;
+    uint64_t requested;
+    uint64_t answered;
+    int32_t answer;
+    uint64_t start_time;
+    uint64_t answer_time;
+    uint64_t budget;
+
+    // The snapshot of the board the plugin is shown.
+    struct snek_plugin_board board;
+    int32_t map[MAP_ROWS][MAP_COLUMNS];
+
+    // How long each recent decision took, and how many ticks were decided or missed.
+    uint64_t samples[PLUGIN_LATENCY_SAMPLES];
+    uint64_t sample_count;
+    uint64_t decisions;
+    uint64_t misses;
+};
+
+// Create a data type for a shared memory control channel between the game and a bot process.
+// The game publishes the board under a sequence lock: the sequence is odd while the board is being written, so readers retry if it was odd or changed while they copied.
+// The bot writes its direction into the command slot, as the tick it answers plus one shifted up a byte, with the direction in the low byte.
+// The game takes the command out of the slot right before each update, so a direction is applied at most once.
+struct snek_channel {
+    char magic[8];
+    uint32_t version;
+    uint32_t rows;
+    uint32_t columns;
+    _Alignas(CHANNEL_CACHE_LINE) _Atomic uint64_t sequence;
+    struct snek_channel_board board;
+    _Alignas(CHANNEL_CACHE_LINE) _Atomic uint64_t command;
+};
+
+// Create a data type for a headless game that updates in constant time, for simulating games far faster than the game is played.
+// The snek entity is a ring buffer of positions from tail to head instead of a linked list, with a map counting how many nodes are on each tile.
+// It has exactly the same rules and food spawning as snek_update(), which the fuzzing harness checks.
+struct snek_engine {
+    int16_t body_row[MAP_ROWS * MAP_COLUMNS];
+    int16_t body_column[MAP_ROWS * MAP_COLUMNS];
+    int32_t head_index;
+    int32_t length;
+    uint8_t occupied[MAP_ROWS][MAP_COLUMNS];
+
+    int32_t direction;
+    int32_t score;
+    int32_t status;
+
+    int32_t food_row;
+    int32_t food_column;
+    uint64_t random_state;
+
+    uint64_t zobrist;
+    int32_t zobrist_direction;
+};
+
+// Create a data type for the header at the start of a level file.
+// The file is used straight from memory after mapping it, so every field is a fixed size and the sections are found by their offset from the start of the file.
+// The tiles section is a tile map to start every update from, the walls section is a bitmap of one bit per tile,
+// and the free section is the row and column of every tile that is not a wall, to spawn food from.
+// Tiles are grey exactly where the bitmap has a wall, so the board drawn matches the board played on.
+// Levels are always the program's map size, so the rows and columns fields only record it and must match it.
+struct snek_level_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t rows;
+    uint32_t columns;
+    uint32_t spawn_row;
+    uint32_t spawn_column;
+    uint32_t free_count;
+    uint32_t tiles_offset;
+    uint32_t walls_offset;
+    uint32_t free_offset;
+    uint32_t size;
+};
+
+// Create a data type for the level being played, pointing into the level file without copying any of it.
+// The level is either a mapped file or the default level built into memory on start up.
+struct snek_level {
+    const struct snek_level_header* header;
+    const int32_t (*tiles)[MAP_COLUMNS];
+    const uint8_t* walls;
+    const uint16_t (*free_cells)[2];
+    void* data;
+    size_t size;
+    bool mapped;
+};
+
+// Create a data type for the random keys used to Zobrist hash game states.
+// A state's hash is every key for what is in it combined with exclusive or, so changing one thing costs one exclusive or in and one out.
+// Candidate keys mark which direction an evaluation in a transposition table is for.
+struct snek_zobrist {
+    uint64_t cell[MAP_ROWS][MAP_COLUMNS];
+    uint64_t head[MAP_ROWS][MAP_COLUMNS];
+    uint64_t food[MAP_ROWS][MAP_COLUMNS];
+    uint64_t direction[4];
+    uint64_t candidate[4];
+};
+
+// Create a data type for an entry in a transposition table.
+// The check is the hash combined with the data by exclusive or, so an entry torn by two threads writing at once fails its check instead of returning wrong data.
+struct snek_transposition_entry {
+    _Atomic uint64_t check;
+    _Atomic uint64_t data;
+};
+
+// Create a data type for a fixed size, lock free transposition table, caching data for game states by their Zobrist hash.
+// Newer entries always replace older ones in the same slot.
+struct snek_transposition_table {
+    struct snek_transposition_entry* entries;
+    uint64_t mask;
+    _Atomic uint64_t probes;
+    _Atomic uint64_t hits;
+};
+
+// Create a data type for the autopilot planner.
+// It scores each direction by playing thousands of random games ahead from a snapshot of the game, spread across a pool of worker threads.
+// Workers wait for a new generation of the snapshot, run rollouts until the deadline or until stopped, then add their results.
+struct snek_planner {
+    SDL_Thread* threads[PLANNER_MAX_THREADS];
+    int32_t thread_count;
+    SDL_mutex* mutex;
+    SDL_cond* start_condition;
+    SDL_cond* done_condition;
+    uint32_t generation;
+    int32_t started;
+    int32_t working;
+    SDL_atomic_t stop;
+    bool quit;
+
+    // Snapshot of the game to plan from, and the performance counter time to stop planning at.
+    struct snek_engine snapshot;
+    uint64_t budget;
+    uint64_t deadline;
+    uint64_t seed;
+
+    // Results of the current plan, as the total value and number of rollouts for each direction.
+    double value[4];
+    uint64_t direction_rollouts[4];
+
+    // Totals over every plan, to report rollouts per second per core.
+    uint64_t rollouts;
+    uint64_t busy_time;
+
+    // Cache of rollout results for each direction from states planned before.
+    struct snek_transposition_table* transpositions;
+};
+
+// Create a data type for the spectator wall, which simulates many headless games and draws them all at once.
+// Every board is drawn into one streaming texture, which takes a single copy per frame to display.
+struct snek_spectator {
+    struct snek_engine* boards;
+    int32_t board_count;
+    int32_t grid_columns;
+    int32_t grid_rows;
+    SDL_Texture* texture;
+
+    // The pixels of an empty board, copied in before drawing each board's entities.
+    uint32_t background[MAP_ROWS * MAP_COLUMNS];
+
+    // Games are seeded by counting up, and turns are chosen from a shared random number generator state.
+    uint64_t seed;
+    uint64_t random_state;
+
+    // Frame timing, reported every few seconds.
+    uint64_t report_time;
+    uint64_t simulate_time;
+    uint64_t draw_time;
+    int32_t frames;
+};
+
+// Create a data type for the header at the start of a trajectory dataset file.
+// The chunk count, row count and index offset are filled in once the last chunk is written.
+// The index is the file offset of every chunk, so readers can map the file and go straight to any chunk.
+struct snek_trajectory_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t flags;
+    uint32_t chunk_rows;
+    uint32_t map_rows;
+    uint32_t map_columns;
+    uint32_t map_size;
+    uint64_t chunk_count;
+    uint64_t row_count;
+    uint64_t index_offset;
+};
+
+// Create a data type for the header at the start of each chunk of a trajectory dataset.
+// Column offsets are from the start of the chunk. Compressed columns are stored as byte deltas from the row before, split into a plane per byte and run length encoded.
+struct snek_trajectory_chunk_header {
+    uint32_t rows;
+    uint32_t flags;
+    uint64_t size;
+    uint64_t column_offset[TRAJECTORY_COLUMNS];
+    uint64_t column_size[TRAJECTORY_COLUMNS];
+};
+
+// Create a data type for a chunk of trajectory rows being buffered in memory, with an array for each column.
+struct snek_trajectory_chunk {
+    uint32_t rows;
+    uint8_t* columns[TRAJECTORY_COLUMNS];
+};
+
+// Create a data type for writing a trajectory dataset.
+// Rows are added to one chunk while a background thread compresses and writes the other, so recording only waits if the writer falls a whole chunk behind.
+struct snek_trajectory_writer {
+    FILE* file;
+    uint32_t flags;
+    struct snek_trajectory_chunk chunks[2];
+    int32_t filling;
+
+    SDL_Thread* thread;
+    SDL_mutex* mutex;
+    SDL_cond* condition;
+    struct snek_trajectory_chunk* pending;
+    bool quit;
+    bool failed;
+
+    // Buffers used by the writer thread to encode a chunk, and the file offset of every chunk written.
+    uint8_t* scratch;
+    uint8_t* output;
+    uint64_t* index;
+    uint64_t chunk_count;
+    uint64_t index_capacity;
+    uint64_t offset;
+    uint64_t row_count;
+
+    // The packed tile map of the level, copied before drawing the entities on each row's map.
+    uint8_t map_template[TRAJECTORY_MAP_SIZE];
+
+    // Time spent waiting for the writer thread, and bytes of columns before and after encoding.
+    uint64_t stall_time;
+    uint64_t raw_bytes;
+    uint64_t encoded_bytes;
 };
 
 // Global Variables:
 // A global pointer to an allocated instance of the snek program on the heap.
 struct snek* snek = NULL;
 
+// The pool that snek entity nodes are taken from, and the allocation counters.
+struct snek_entity_pool snek_entity_pool;
+struct snek_allocations snek_allocations;
+
+// When main() started, to measure time to first frame from.
+uint64_t snek_launch_time = 0;
+
+// The keys for Zobrist hashing, which are the same every run so hashes can be compared between runs.
+struct snek_zobrist snek_zobrist;
+
+// The level being played, which both snek_update() and the headless engine read walls, the spawn point and free tiles from.
+struct snek_level snek_level;
+
+// The size of a value in each column of a trajectory dataset.
+const uint32_t snek_trajectory_column_sizes[TRAJECTORY_COLUMNS] = {4, 4, 1, 1, 1, 1, 1, 2, TRAJECTORY_MAP_SIZE};
+
+// Count heap allocations towards the program status they are made in.
+// With glibc, every allocation in the process is counted by standing in for malloc(), calloc(), realloc() and the aligned allocators, and passing them on to glibc.
+// Elsewhere, allocation counting is not available and the counters stay at zero.
+#if defined(__GLIBC__) && !defined(__EMSCRIPTEN__)
+    #define SNEK_ALLOCATION_COUNTING
+    extern void* __libc_malloc(size_t size);
+    extern void* __libc_calloc(size_t count, size_t size);
+    extern void* __libc_realloc(void* pointer, size_t size);
+    extern void* __libc_memalign(size_t alignment, size_t size);
+    extern void* __libc_valloc(size_t size);
+
+    void snek_allocation_count() {
+        int32_t status = atomic_load_explicit(&snek_allocations.status, memory_order_relaxed);
+        atomic_fetch_add_explicit(&snek_allocations.count[status], 1, memory_order_relaxed);
+    }
+
+    void* malloc(size_t size) {
+        snek_allocation_count();
+        return __libc_malloc(size);
+    }
+
+    void* calloc(size_t count, size_t size) {
+        snek_allocation_count();
+        return __libc_calloc(count, size);
+    }
+
+    void* realloc(void* pointer, size_t size) {
+        snek_allocation_count();
+        return __libc_realloc(pointer, size);
+    }
+
+    void* memalign(size_t alignment, size_t size) {
+        snek_allocation_count();
+        return __libc_memalign(alignment, size);
+    }
+
+    void* aligned_alloc(size_t alignment, size_t size) {
+        snek_allocation_count();
+        return __libc_memalign(alignment, size);
+    }
+
+    int posix_memalign(void** pointer, size_t alignment, size_t size) {
+        if (alignment % sizeof(void*) != 0 || (alignment & (alignment - 1)) != 0) {
+            return EINVAL;
+        }
+        snek_allocation_count();
+        void* memory = __libc_memalign(alignment, size);
+        if (memory == NULL && size > 0) {
+            return ENOMEM;
+        }
+        *pointer = memory;
+        return 0;
+    }
+
+    void* valloc(size_t size) {
+        snek_allocation_count();
+        return __libc_valloc(size);
+    }
+#endif
+
+// Set the program status that allocations are counted towards.
+void snek_allocation_status(int32_t status) {
+    atomic_store_explicit(&snek_allocations.status, status, memory_order_relaxed);
+}
+
+// Print the number of allocations made in each program status since they were last printed, then clear them.
+void snek_allocation_print() {
+    const char* names[STATUS_COUNT] = {"start menu", "mid game", "game over", "quit", "pause"};
+    printf("Allocations:");
+    for (int32_t i = 0; i < STATUS_COUNT; i++) {
+        if (i != QUIT_LOOP) {
+            printf(" %s %llu%s", names[i], (unsigned long long)atomic_exchange(&snek_allocations.count[i], 0), i == STATUS_COUNT - 1 ? "" : ",");
+        }
+    }
+    #ifdef SNEK_ALLOCATION_COUNTING
+        printf("\n");
+    #else
+        printf(" (allocation counting needs glibc)\n");
+    #endif
+}
+
+// Link every node of the snek entity pool into its free list.
+// This must only be done while no snek entity is using the pool.
+void snek_entity_pool_init() {
+    snek_entity_pool.free_list = NULL;
+    for (int32_t i = ENTITY_POOL_SIZE - 1; i >= 0; i--) {
+        snek_entity_pool.nodes[i].next = snek_entity_pool.free_list;
+        snek_entity_pool.free_list = &snek_entity_pool.nodes[i];
+    }
+}
+
 // Return a pointer to a new instance of a snek entity node with the passed in row and column with information
+// Nodes are taken from the pool, and only allocated on the heap if the pool has run out.
 // Returns pointer on success, and returns NULL on failure.
 struct snek_entity* snek_entity_new(int32_t row, int32_t column) {
-    // Allocate memory for the new node.
-    struct snek_entity* new_snek_entity = NULL;
-    new_snek_entity = (struct snek_entity*)malloc(sizeof(struct snek_entity));
+    // Take a node from the pool, or allocate memory for the new node.
+    struct snek_entity* new_snek_entity = snek_entity_pool.free_list;
+    if (new_snek_entity != NULL) {
+        snek_entity_pool.free_list = new_snek_entity->next;
+    } else {
+        new_snek_entity = (struct snek_entity*)malloc(sizeof(struct snek_entity));
+        snek_entity_pool.fallbacks++;
+    }
 
     // Return an error and false if memory allocation failed.
     if (new_snek_entity == NULL) {
@@ -156,10 +764,15 @@ bool snek_entity_free(struct snek_entity* snek_entity) {
     struct snek_entity* next = NULL;
 
     // Traverse through the snek entity linked list.
-    // Store the value of the next node, free the current node, and go to the next node until all memory is freed.
+    // Store the value of the next node, give the current node back to the pool or free it, and go to the next node until all memory is freed.
     while (temp != NULL) {
         next = temp->next;
-        free(temp);
+        if (temp >= snek_entity_pool.nodes && temp < snek_entity_pool.nodes + ENTITY_POOL_SIZE) {
+            temp->next = snek_entity_pool.free_list;
+            snek_entity_pool.free_list = temp;
+        } else {
+            free(temp);
+        }
         temp = next;
     }
 
@@ -191,782 +804,4255 @@ bool snek_entity_print(struct snek_entity* snek_entity) {
     return true;
 }
 
-// Spawn a new instance of a food entity:
-// Ensure it is outside wherever the snek entity exists.
-bool snek_food_entity_spawn() {
-    // Return if the global entity pointer does not point to a valid location on heap.
-    if (snek == NULL) {
-        printf("snek_food_entity_spawn(): Global snek variable is NULL. Returning false.\n");
-        return false;
+// Add a sample in milliseconds to a latency histogram.
+// Samples that are slower than the histogram can hold are counted in the last bucket.
+void snek_latency_histogram_add(uint32_t* histogram, uint32_t milliseconds) {
+    if (milliseconds >= LATENCY_BUCKETS) {
+        milliseconds = LATENCY_BUCKETS - 1;
     }
+    histogram[milliseconds]++;
+}
 
-    // There is no need to check if the snek entity is NULL or valid.
-    // That is because if it is equal to NULL, then the loop will be executed once and exit.
-    int32_t food_is_inside_snek = 1;
-    struct snek_entity* temp = snek->head;
-    
-    // Keep trying to spawn a random location for the food within bounds of the tile map.
-    // Ensure it is outside every node in the snek entity.
-
-    // If the function is taking too long, then quit after 10 seconds.
-    // This is due to the randomness of trying to find a solution.
-    // This is to prevent the program hanging for too long if something goes wrong.
-    int32_t current_time = SDL_GetTicks();
-    int32_t last_time = current_time;
+// Return the bucket in milliseconds that the passed in percentile of a latency histogram falls in.
+uint32_t snek_latency_percentile(uint32_t* histogram, uint32_t samples, uint32_t percentile) {
+    // Find the number of samples that must be at or below the bucket, rounding up.
+    uint32_t target = (samples * percentile + 99) / 100;
+    uint32_t count = 0;
 
-    srand(time(0));
-    while (food_is_inside_snek == 1) {
-        food_is_inside_snek = 0;
+    for (uint32_t i = 0; i < LATENCY_BUCKETS; i++) {
+        count += histogram[i];
+        if (count >= target && count > 0) {
+            return i;
+        }
+    }
+    return LATENCY_BUCKETS - 1;
+}
 
-        // Calculate new food position
-        // Spawn the food inside the designated zone for the gameplay.
-        // This is because there are defined borders for the game around the edges.
-        snek->food_row = rand() % ((MAP_ROWS - 2) + 1 - 2) + 2;
-        snek->food_column = rand() % ((MAP_COLUMNS - 2) + 1 - 1) + 1;
+// Clear all latency data, so the next game starts with empty histograms.
+void snek_latency_reset(struct snek_latency* latency) {
+    memset(latency, 0, sizeof(struct snek_latency));
+}
 
-        // Traverse through the snek entity and every node.
-        // If any node matches the position of the food entity, try again.
-        while (temp != NULL) {
-            if (temp->row == snek->food_row && temp->column == snek->food_column) {
-                food_is_inside_snek = 1;
-            }
-            temp = temp->next;
-        }
+// Record the timestamp of an input that changed the snek entity's direction.
+void snek_latency_input(struct snek_latency* latency, uint32_t input_time) {
+    if (latency->pending_count < LATENCY_PENDING_MAX) {
+        latency->pending_input_time[latency->pending_count] = input_time;
+        latency->pending_count++;
+    }
+}
 
-        // If enough time has elapsed since the loop has been entered, this means the function is taking too long.
-        // Give up trying to search for a new food location and quit the loop.
-        current_time = SDL_GetTicks();
-        if (current_time > last_time + 10000) {
-            printf("snek_food_entity_spawn(): Function is taking too long to find a solution. Returning false.\n");
-            return false;
-        }
+// Record that a tick has applied every pending input.
+// The inputs are then waiting for the next present to show them.
+void snek_latency_tick(struct snek_latency* latency, uint32_t tick_time) {
+    for (int32_t i = 0; i < latency->pending_count && latency->applied_count < LATENCY_PENDING_MAX; i++) {
+        latency->applied_input_time[latency->applied_count] = latency->pending_input_time[i];
+        latency->applied_count++;
     }
+    latency->pending_count = 0;
 
-    // At this point, a valid food location that isn't intersecting with a snek entity should have been successfully found.
-    // Return true.
-    return true;
+    // Only the first tick matters, since the photons of a later tick are never the first to show an input.
+    if (latency->applied_count > 0 && latency->applied_tick_time == 0) {
+        latency->applied_tick_time = tick_time;
+    }
 }
 
-// Render text to location on renderer:
-bool snek_render_text(char* text, int32_t x, int32_t y, int32_t w, int32_t h) {
-    // Return if the global entity pointer does not point to a valid location on heap.
-    if (snek == NULL) {
-        printf("snek_food_entity_spawn(): Global snek variable is NULL. Returning false.\n");
-        return false;
+// Record that a frame showing every applied input has been presented, and add all samples to the histograms.
+void snek_latency_present(struct snek_latency* latency, uint32_t present_time) {
+    for (int32_t i = 0; i < latency->applied_count; i++) {
+        snek_latency_histogram_add(latency->input_to_tick, latency->applied_tick_time - latency->applied_input_time[i]);
+        snek_latency_histogram_add(latency->tick_to_photon, present_time - latency->applied_tick_time);
+        snek_latency_histogram_add(latency->input_to_photon, present_time - latency->applied_input_time[i]);
+        latency->samples++;
     }
+    latency->applied_count = 0;
+    latency->applied_tick_time = 0;
+}
 
-    if (text == NULL) {
-        printf("snek_food_entity_spawn(): Invalid text pointer. Returning false.\n");
-        return false;
-    }
+// Print a summary of one latency histogram, followed by every non empty bucket.
+void snek_latency_print_histogram(char* name, uint32_t* histogram, uint32_t samples) {
+    printf("%s: p50 %ums p90 %ums p99 %ums\n", name,
+        snek_latency_percentile(histogram, samples, 50),
+        snek_latency_percentile(histogram, samples, 90),
+        snek_latency_percentile(histogram, samples, 99));
 
-    // Create the score string texture
-    SDL_Color white = {255, 255, 255};
-    SDL_Surface* text_surface = TTF_RenderText_Solid(snek->font, text, white);
-    SDL_Texture* text_texture = SDL_CreateTextureFromSurface(snek->renderer, text_surface);
+    for (uint32_t i = 0; i < LATENCY_BUCKETS; i++) {
+        if (histogram[i] != 0) {
+            printf("  %s%3ums: %u\n", i == LATENCY_BUCKETS - 1 ? ">=" : "  ", i, histogram[i]);
+        }
+    }
+}
 
-    // Set the position the texture will be put in the screen.
-    SDL_Rect text_rect;
-    text_rect.x = x;
-    text_rect.y = y;
-    text_rect.w = w;
-    text_rect.h = h;
+// Print the latency histograms recorded over a game.
+void snek_latency_print(struct snek_latency* latency, bool late_latch) {
+    printf("Input latency over %u inputs (late latch %s):\n", latency->samples, late_latch ? "on" : "off");
+    if (latency->samples == 0) {
+        return;
+    }
 
-    // Copy the score texture to the renderer.
-    SDL_RenderCopy(snek->renderer, text_texture, NULL, &text_rect);
+    snek_latency_print_histogram("Input to tick", latency->input_to_tick, latency->samples);
+    snek_latency_print_histogram("Tick to photon", latency->tick_to_photon, latency->samples);
+    snek_latency_print_histogram("Input to photon", latency->input_to_photon, latency->samples);
+}
 
-    SDL_DestroyTexture(text_texture);
+// Seed a random number generator state.
+// Mix the seed so that similar seeds give unrelated sequences, and make sure the state is never zero.
+uint64_t snek_random_seed(uint64_t seed) {
+    uint64_t state = seed + 0x9E3779B97F4A7C15ULL;
+    state = (state ^ (state >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    state = (state ^ (state >> 27)) * 0x94D049BB133111EBULL;
+    state = state ^ (state >> 31);
+    if (state == 0) {
+        state = 0x9E3779B97F4A7C15ULL;
+    }
+    return state;
+}
 
-    return true;
+// Return the next random number from a random number generator state, and advance the state.
+// This is an xorshift generator, which is fast and the same on every platform unlike rand().
+uint32_t snek_random(uint64_t* state) {
+    uint64_t x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return (uint32_t)((x * 0x2545F4914F6CDD1DULL) >> 32);
 }
 
-// Initialise the tile map that is the world that the entities reside/exist in.
-bool snek_map_init() {
-    // Return failure if the global entity pointer does not point to a valid location on heap.
-    if (snek == NULL) {
-        printf("snek_map_init(): Snek global variable is NULL. Returning false.\n");
-        return false;
+// Mix a value into a running FNV-1a state hash.
+uint64_t snek_hash_mix(uint64_t hash, int32_t value) {
+    for (int32_t i = 0; i < 4; i++) {
+        hash ^= (uint8_t)(value >> (i * 8));
+        hash *= 0x100000001B3ULL;
     }
+    return hash;
+}
 
-    // Set all tiles on the tile map to black.
-    for (int32_t i = 0; i < MAP_ROWS; i++) {
-        for (int32_t j = 0; j < MAP_COLUMNS; j++) {
-            snek->map[i][j] = BLACK;
-        }
+// Initialise the keys for Zobrist hashing from a fixed seed.
+void snek_zobrist_init() {
+    uint64_t random_state = snek_random_seed(0x5A0B8157);
+    uint64_t* keys = (uint64_t*) &snek_zobrist;
+    for (size_t i = 0; i < sizeof(struct snek_zobrist) / sizeof(uint64_t); i++) {
+        keys[i] = ((uint64_t)snek_random(&random_state) << 32) | snek_random(&random_state);
     }
+}
 
-    // Set the designated wall tiles.
-    // These are the first two rows, the last row.
-    // They are also the first and last column:
-    for (int32_t i = 0; i < MAP_COLUMNS; i++) {
-        snek->map[0][i] = GREY;
-        snek->map[1][i] = GREY;
-        snek->map[MAP_ROWS-1][i] = GREY;
+// Create a new transposition table with two to the power of the passed in bits entries.
+// Returns pointer on success, and returns NULL on failure.
+struct snek_transposition_table* snek_transposition_new(int32_t bits) {
+    struct snek_transposition_table* table = (struct snek_transposition_table*) calloc(1, sizeof(struct snek_transposition_table));
+    if (table == NULL) {
+        printf("snek_transposition_new(): Failed to allocate memory for transposition table. Returning NULL.\n");
+        return NULL;
     }
 
-    for (int32_t i = 0; i < MAP_ROWS; i++) {
-        snek->map[i][0] = GREY;
-        snek->map[i][MAP_COLUMNS-1] = GREY;
+    table->entries = (struct snek_transposition_entry*) calloc((size_t)1 << bits, sizeof(struct snek_transposition_entry));
+    if (table->entries == NULL) {
+        printf("snek_transposition_new(): Failed to allocate memory for transposition table entries. Returning NULL.\n");
+        free(table);
+        return NULL;
     }
+    table->mask = ((uint64_t)1 << bits) - 1;
 
+    return table;
+}
 
-    // Return success.
-    return true;
+// Free a transposition table.
+void snek_transposition_free(struct snek_transposition_table* table) {
+    if (table == NULL) {
+        return;
+    }
+    free(table->entries);
+    free(table);
 }
 
-// Initialise the global snek instance:
-// Return true on success, and false on failure.
-bool snek_init() {
-    // Set the snek pointer global variable to point to a valid allocated chunk of memory in the heap.
-    // Return on failure to do so.
-    snek = (struct snek*) malloc(sizeof(struct snek));
-    if (snek == NULL) {
-        printf("snek_init(): Malloc failed when trying to assign memory to snek global pointer. Returning false.\n");
+// Look up the data stored for a hash in a transposition table.
+// Return true and set the data if it is there, and false otherwise.
+bool snek_transposition_probe(struct snek_transposition_table* table, uint64_t hash, uint64_t* data) {
+    struct snek_transposition_entry* entry = &table->entries[hash & table->mask];
+    uint64_t check = atomic_load_explicit(&entry->check, memory_order_relaxed);
+    uint64_t entry_data = atomic_load_explicit(&entry->data, memory_order_relaxed);
+    atomic_fetch_add_explicit(&table->probes, 1, memory_order_relaxed);
+
+    if ((check ^ entry_data) != hash) {
         return false;
     }
 
-    // Attempt to initialise SDL.
-    // // Return failure on failure to do so and free all allocated resources.
-    if (SDL_Init(SDL_INIT_VIDEO) != 0) {
-        printf("snek_init(): Failed to initialise SDL. SDL_GetError(): %s. Returning false.\n", SDL_GetError());
-        free(snek);
-        snek = NULL;
+    atomic_fetch_add_explicit(&table->hits, 1, memory_order_relaxed);
+    *data = entry_data;
+    return true;
+}
+
+// Store data for a hash in a transposition table, replacing whatever was in its slot.
+void snek_transposition_store(struct snek_transposition_table* table, uint64_t hash, uint64_t data) {
+    struct snek_transposition_entry* entry = &table->entries[hash & table->mask];
+    atomic_store_explicit(&entry->check, hash ^ data, memory_order_relaxed);
+    atomic_store_explicit(&entry->data, data, memory_order_relaxed);
+}
+
+// Return true if the tile at the passed in position is a wall on the current level.
+// Every level has walls all the way around its edges, so a snek entity that moves one tile from inside the map is never outside it.
+bool snek_level_is_wall(int32_t row, int32_t column) {
+    int32_t index = row * MAP_COLUMNS + column;
+    return (snek_level.walls[index >> 3] >> (index & 7)) & 1;
+}
+
+// Round a level file section's size up so the section after it is aligned.
+uint32_t snek_level_align(uint32_t size) {
+    return (size + LEVEL_ALIGNMENT - 1) / LEVEL_ALIGNMENT * LEVEL_ALIGNMENT;
+}
+
+// Point the current level at level data in memory, checking its header and sections fit inside it.
+// The header, edges, free tiles and tile map are checked, as tiles are used to index colours and must agree with the wall bitmap.
+// Return true on success, and false if the data is not a valid level.
+bool snek_level_open(void* data, size_t size, bool mapped) {
+    const struct snek_level_header* header = (const struct snek_level_header*) data;
+    if (size < sizeof(struct snek_level_header) || memcmp(header->magic, LEVEL_MAGIC, 8) != 0 || header->version != LEVEL_VERSION) {
+        printf("snek_level_open(): Data is not a snek level of version %d. Returning false.\n", LEVEL_VERSION);
         return false;
     }
 
-    // Attempt to initialise SDL Window.
-    // // Return failure on failure to do so and free all allocated resources.
-    snek->window = SDL_CreateWindow("Snek", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, SCREEN_WIDTH, SCREEN_HEIGHT, SDL_WINDOW_SHOWN);
-    if (snek->window == NULL) {
-        printf("snek_init(): Failed to initialise SDL Window. SDL_GetError(): %s. Returning false.\n", SDL_GetError());
-        SDL_Quit();
-        free(snek);
-        snek = NULL;
+    // The tile map is the same size as the program's, so levels must be built for the same map size.
+    if (header->rows != MAP_ROWS || header->columns != MAP_COLUMNS) {
+        printf("snek_level_open(): Level is %ux%u, but this program plays on %dx%d maps. Returning false.\n", header->rows, header->columns, MAP_ROWS, MAP_COLUMNS);
         return false;
     }
 
-    // Attempt to initialise SDL Renderer. 
-    // Return failure on failure to do so and free all allocated resources.
-    snek->renderer = SDL_CreateRenderer(snek->window, -1, SDL_RENDERER_ACCELERATED);
-    if (snek->renderer == NULL) {
-        printf("snek_init(): Failed to initialise SDL Window. SDL_GetError(): %s. Returning false.\n", SDL_GetError());
-        SDL_DestroyWindow(snek->window);
-        SDL_Quit();
-        free(snek);
-        snek = NULL;
+    uint32_t tiles_size = sizeof(int32_t) * MAP_ROWS * MAP_COLUMNS;
+    uint32_t walls_size = (MAP_ROWS * MAP_COLUMNS + 7) / 8;
+    uint32_t free_size = sizeof(uint16_t) * 2 * header->free_count;
+    if (header->size > size || header->free_count == 0 || header->free_count > MAP_ROWS * MAP_COLUMNS
+        || header->tiles_offset % LEVEL_ALIGNMENT != 0 || header->walls_offset % LEVEL_ALIGNMENT != 0 || header->free_offset % LEVEL_ALIGNMENT != 0
+        || (uint64_t)header->tiles_offset + tiles_size > header->size || (uint64_t)header->walls_offset + walls_size > header->size
+        || (uint64_t)header->free_offset + free_size > header->size) {
+        printf("snek_level_open(): Level sections do not fit inside the level. Returning false.\n");
         return false;
     }
 
-    // Attempt to initialise snek entity. 
-    // Return failure on failure to do so and free all allocated resources.
-    // Spawn the snek entity in the middle of the map or screen.
-    snek->head = snek_entity_new(MAP_ROWS/2, MAP_COLUMNS/2);
-    if (snek->head == NULL) {
-        printf("snek_init(): snek_entity_new() failed to create snek entity for program. Returning false.\n");
-        SDL_DestroyRenderer(snek->renderer);
-        SDL_DestroyWindow(snek->window);
-        SDL_Quit();
-        free(snek);
-        snek = NULL;
-        return false;
+    struct snek_level level = {0};
+    level.header = header;
+    level.tiles = (const int32_t (*)[MAP_COLUMNS]) ((uint8_t*)data + header->tiles_offset);
+    level.walls = (uint8_t*)data + header->walls_offset;
+    level.free_cells = (const uint16_t (*)[2]) ((uint8_t*)data + header->free_offset);
+    level.data = data;
+    level.size = size;
+    level.mapped = mapped;
+
+    // Check against the new level's walls before switching to it.
+    struct snek_level previous = snek_level;
+    snek_level = level;
+    bool valid = header->spawn_row < MAP_ROWS && header->spawn_column < MAP_COLUMNS && snek_level_is_wall(header->spawn_row, header->spawn_column) == false;
+    for (int32_t i = 0; i < MAP_COLUMNS && valid == true; i++) {
+        valid = snek_level_is_wall(0, i) == true && snek_level_is_wall(MAP_ROWS - 1, i) == true;
+    }
+    for (int32_t i = 0; i < MAP_ROWS && valid == true; i++) {
+        valid = snek_level_is_wall(i, 0) == true && snek_level_is_wall(i, MAP_COLUMNS - 1) == true;
+    }
+    for (uint32_t i = 0; i < header->free_count && valid == true; i++) {
+        valid = level.free_cells[i][0] < MAP_ROWS && level.free_cells[i][1] < MAP_COLUMNS && snek_level_is_wall(level.free_cells[i][0], level.free_cells[i][1]) == false;
     }
 
-    // Initialise the tile map.
-    // Return failure on failure to do so and free all allocated resources.
-    if (snek_map_init() == false) {
-        printf("snek_init(): snek_map_init() failed to initialise map for program. Returning false.\n");
-        SDL_DestroyRenderer(snek->renderer);
-        SDL_DestroyWindow(snek->window);
-        SDL_Quit();
-        snek_entity_free(snek->head);
-        free(snek);
-        snek = NULL;
-        return false;        
+    // The free tiles must be every tile that is not a wall, each listed once, or spawning food could search forever.
+    // Every free tile is off the walls by now, so listing each once and as many as there are open tiles means all of them are listed.
+    uint8_t listed[(MAP_ROWS * MAP_COLUMNS + 7) / 8] = {0};
+    uint32_t open_count = 0;
+    for (int32_t i = 0; i < MAP_ROWS && valid == true; i++) {
+        for (int32_t j = 0; j < MAP_COLUMNS; j++) {
+            open_count += snek_level_is_wall(i, j) == false;
+        }
+    }
+    for (uint32_t i = 0; i < header->free_count && valid == true; i++) {
+        int32_t index = level.free_cells[i][0] * MAP_COLUMNS + level.free_cells[i][1];
+        valid = ((listed[index >> 3] >> (index & 7)) & 1) == 0;
+        listed[index >> 3] |= 1 << (index & 7);
+    }
+    valid = valid && open_count == header->free_count;
+    if (valid == false) {
+        printf("snek_level_open(): Level has a spawn point or free tile on a wall or off the map, a gap in its edges, or free tiles that are not every open tile once. Returning false.\n");
+        snek_level = previous;
+        return false;
     }
 
-    // Spawn the food in a random unique location away from the snek entity
-    // Return failure on failure to do so and free all allocated resources.
-    if (snek_food_entity_spawn() == false) {
-        printf("snek_init(): snek_food_entity_spawn() failed to find food spawn location for program. Returning false.\n");
-        SDL_DestroyRenderer(snek->renderer);
-        SDL_DestroyWindow(snek->window);
-        SDL_Quit();
-        snek_entity_free(snek->head);
-        free(snek);
-        snek = NULL;
-        return false;    
+    // Every tile must have a colour, and be grey only where there is a wall.
+    for (int32_t i = 0; i < MAP_ROWS && valid == true; i++) {
+        for (int32_t j = 0; j < MAP_COLUMNS && valid == true; j++) {
+            int32_t tile = level.tiles[i][j];
+            valid = tile >= 0 && tile < TILE_COLOURS && (tile == GREY) == snek_level_is_wall(i, j);
+        }
+    }
+    if (valid == false) {
+        printf("snek_level_open(): Level has a tile with no colour, or a tile map that does not match its walls. Returning false.\n");
+        snek_level = previous;
+        return false;
     }
 
-    // Initialise TTF Engine:
-    // Return failure on failure to do so and free all allocated resources.
-    if (TTF_Init() != 0) {
-        printf("snek_init(): Failed to intialise TTF rendering engine. Returning false.\n");
-        SDL_DestroyRenderer(snek->renderer);
-        SDL_DestroyWindow(snek->window);
-        SDL_Quit();
-        snek_entity_free(snek->head);
-        free(snek);
-        snek = NULL;
-        return false;  
+    return true;
+}
+
+// Close the current level, unmapping or freeing its data.
+void snek_level_close() {
+    if (snek_level.data == NULL) {
+        return;
+    }
+    if (snek_level.mapped == true) {
+        munmap(snek_level.data, snek_level.size);
+    } else {
+        free(snek_level.data);
     }
+    memset(&snek_level, 0, sizeof(struct snek_level));
+}
 
-    // Open TTF font.
-    // Return failure on failure to do so and free all allocated resources.
-    snek->font = TTF_OpenFont("third_party/roboto_mono/RobotoMono-Bold.ttf", 24);
-    if (snek->font == NULL) {
-        printf("snek_init(): Failed to open TTF font. Returning false.\n");
-        SDL_DestroyRenderer(snek->renderer);
-        SDL_DestroyWindow(snek->window);
-        SDL_Quit();
-        TTF_Quit();
-        snek_entity_free(snek->head);
-        free(snek);
-        snek = NULL;
-        return false; 
+// Build level data in memory from which tiles are walls and the spawn point, working out the tile map and free tiles.
+// Return a pointer to the data on success and set its size, and return NULL on failure.
+void* snek_level_build(bool walls[MAP_ROWS][MAP_COLUMNS], int32_t spawn_row, int32_t spawn_column, size_t* size) {
+    uint32_t free_count = 0;
+    for (int32_t i = 0; i < MAP_ROWS; i++) {
+        for (int32_t j = 0; j < MAP_COLUMNS; j++) {
+            free_count += walls[i][j] == false;
+        }
     }
 
-    // Assign a default direction for the snek entity.
-    // This is just an initialisation step, in practise a user's input will be what is assigned.
-    snek->direction = UP;
+    struct snek_level_header header = {0};
+    memcpy(header.magic, LEVEL_MAGIC, 8);
+    header.version = LEVEL_VERSION;
+    header.rows = MAP_ROWS;
+    header.columns = MAP_COLUMNS;
+    header.spawn_row = spawn_row;
+    header.spawn_column = spawn_column;
+    header.free_count = free_count;
+    header.tiles_offset = snek_level_align(sizeof(struct snek_level_header));
+    header.walls_offset = header.tiles_offset + snek_level_align(sizeof(int32_t) * MAP_ROWS * MAP_COLUMNS);
+    header.free_offset = header.walls_offset + snek_level_align((MAP_ROWS * MAP_COLUMNS + 7) / 8);
+    header.size = header.free_offset + snek_level_align(sizeof(uint16_t) * 2 * free_count);
+
+    uint8_t* data = (uint8_t*) calloc(1, header.size);
+    if (data == NULL) {
+        printf("snek_level_build(): Failed to allocate memory for level. Returning NULL.\n");
+        return NULL;
+    }
+    memcpy(data, &header, sizeof(struct snek_level_header));
 
-    // Set the program status to start, which means that it will wait for user input before beginning the gameplay.
-    snek->status = START_MENU;
+    int32_t (*tiles)[MAP_COLUMNS] = (int32_t (*)[MAP_COLUMNS]) (data + header.tiles_offset);
+    uint16_t (*free_cells)[2] = (uint16_t (*)[2]) (data + header.free_offset);
+    free_count = 0;
+    for (int32_t i = 0; i < MAP_ROWS; i++) {
+        for (int32_t j = 0; j < MAP_COLUMNS; j++) {
+            int32_t index = i * MAP_COLUMNS + j;
+            if (walls[i][j] == true) {
+                tiles[i][j] = GREY;
+                data[header.walls_offset + (index >> 3)] |= 1 << (index & 7);
+            } else {
+                tiles[i][j] = BLACK;
+                free_cells[free_count][0] = i;
+                free_cells[free_count][1] = j;
+                free_count++;
+            }
+        }
+    }
 
-    // Initialise timer.
-    snek->last_time = 0;
+    *size = header.size;
+    return data;
+}
 
-    // Initialise score:
-    snek->score = 1;
+// Build the default level in memory and make it the current level.
+// The walls are the first two rows, the last row, and the first and last column, with the snek entity spawning in the middle.
+bool snek_level_default() {
+    bool walls[MAP_ROWS][MAP_COLUMNS];
+    for (int32_t i = 0; i < MAP_ROWS; i++) {
+        for (int32_t j = 0; j < MAP_COLUMNS; j++) {
+            walls[i][j] = i <= 1 || i == MAP_ROWS - 1 || j == 0 || j == MAP_COLUMNS - 1;
+        }
+    }
 
-    // Initialise Difficulty:
-    snek->difficulty = REGULAR;
+    size_t size = 0;
+    void* data = snek_level_build(walls, MAP_ROWS/2, MAP_COLUMNS/2, &size);
+    if (data == NULL) {
+        printf("snek_level_default(): snek_level_build() failed. Returning false.\n");
+        return false;
+    }
 
-    // Return true if all initialisation steps have succeeded.
+    snek_level_close();
+    if (snek_level_open(data, size, false) == false) {
+        free(data);
+        return false;
+    }
     return true;
 }
 
-// Quit SDL and free all memory allocated to snek on heap.
-// Return true on success, and false on failure.
-bool snek_quit() {
-    // Return false if the global variable snek pointer is set to NULL.
-    if (snek == NULL) {
-        printf("snek_quit(): Snek global variable is equal to NULL. Returning false.\n");
+// Map a level file into memory and make it the current level.
+// Nothing is read from the file up front. Its pages are used in place as the game reads them.
+// Return true on success, and false on failure, keeping the current level.
+bool snek_level_load(const char* path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        printf("snek_level_load(): Failed to open level file %s. Returning false.\n", path);
         return false;
     }
 
-    // Free resources associated with SDL and quit SDL.
-    SDL_DestroyRenderer(snek->renderer);
-    SDL_DestroyWindow(snek->window);
-    SDL_Quit();
-
-    // Quit TTF renderer.
-    TTF_Quit();
+    struct stat file_status;
+    if (fstat(fd, &file_status) != 0 || file_status.st_size < (off_t)sizeof(struct snek_level_header)) {
+        printf("snek_level_load(): Level file %s is too small to be a level. Returning false.\n", path);
+        close(fd);
+        return false;
+    }
 
-    // Free all memory assigned to snek entity.
-    if (snek->head != NULL) {
-        snek_entity_free(snek->head);
+    void* data = mmap(NULL, file_status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        printf("snek_level_load(): Failed to map level file %s. Returning false.\n", path);
+        return false;
     }
 
-    // Free the snek global variable from the heap.
-    free(snek);
+    struct snek_level previous = snek_level;
+    if (snek_level_open(data, file_status.st_size, true) == false) {
+        printf("snek_level_load(): Level file %s is not valid. Returning false.\n", path);
+        munmap(data, file_status.st_size);
+        return false;
+    }
 
-    // Return true.
+    // Free the previous level now the new one has replaced it.
+    if (previous.data != NULL) {
+        if (previous.mapped == true) {
+            munmap(previous.data, previous.size);
+        } else {
+            free(previous.data);
+        }
+    }
     return true;
 }
 
-// Render the tilemap onto the screen.
+// Convert a text level into a level file.
+// The text has a line for each row of the map, with # for a wall, S for the spawn point and any other character for an empty tile.
 // Return true on success, and false on failure.
-bool snek_render() {
-    // Return false if the snek global variable pointer does not point to a valid memory location on heap.
-    if (snek == NULL) {
-        printf("snek_render(): Snek global variable pointer is NULL. Returning false.\n");
+bool snek_level_convert(const char* text_path, const char* level_path) {
+    FILE* text = fopen(text_path, "r");
+    if (text == NULL) {
+        printf("snek_level_convert(): Failed to open text level %s. Returning false.\n", text_path);
         return false;
     }
 
-    // Set the screen to grey.
-    SDL_SetRenderDrawColor(snek->renderer, 32, 32, 32, 0);
-    SDL_RenderClear(snek->renderer);
-
-    // Initialise a rect for SDL to draw with, with appropriate position and dimensions
-    SDL_Rect render_rect;
-    render_rect.w = SCREEN_WIDTH/MAP_COLUMNS;
-    render_rect.h = SCREEN_HEIGHT/MAP_ROWS;
-    render_rect.x = 0;
-    render_rect.y = 0;
-
-    // Traverse through the tile map.
-    // Get the render colour and calculate position to draw a tile of said colour and draw it for each tile.
-    for (int32_t i=0; i < MAP_ROWS; i++) {
-        for (int32_t j=0; j < MAP_COLUMNS; j++) {
-            render_rect.x = j * render_rect.w;
-            render_rect.y = i * render_rect.h;
-
-            switch (snek->map[i][j]) {
-                // Skip calling black tile renders since they were already rendered in the clear.
-                case BLACK:
-                    SDL_SetRenderDrawColor(snek->renderer, 0, 0, 0, 0);
-                    SDL_RenderFillRect(snek->renderer, &render_rect);
-                    break;
-
-                case HEAD:
-                    SDL_SetRenderDrawColor(snek->renderer, 0, 200, 20, 0);
-                    SDL_RenderFillRect(snek->renderer, &render_rect);
-                    break;
-
-                case GREEN:
-                    SDL_SetRenderDrawColor(snek->renderer, 0, 200, 60, 0);
-                    SDL_RenderFillRect(snek->renderer, &render_rect);
-                    break;
-
-                case GREY:
-                    SDL_SetRenderDrawColor(snek->renderer, 32, 32, 32, 0);
-                    SDL_RenderFillRect(snek->renderer, &render_rect);
-                    break;
-
-                case RED:
-                    SDL_SetRenderDrawColor(snek->renderer, 255, 0, 0, 0);
-                    SDL_RenderFillRect(snek->renderer, &render_rect);
-                    break;
+    bool walls[MAP_ROWS][MAP_COLUMNS];
+    int32_t spawn_row = -1;
+    int32_t spawn_column = -1;
+    char line[MAP_COLUMNS + 3];
+    int32_t rows = 0;
+    while (rows < MAP_ROWS && fgets(line, sizeof(line), text) != NULL) {
+        int32_t length = strcspn(line, "\r\n");
+        if (length != MAP_COLUMNS) {
+            printf("snek_level_convert(): Row %d of %s is %d tiles long instead of %d. Returning false.\n", rows + 1, text_path, length, MAP_COLUMNS);
+            fclose(text);
+            return false;
+        }
+        for (int32_t j = 0; j < MAP_COLUMNS; j++) {
+            walls[rows][j] = line[j] == '#';
+            if (line[j] == 'S') {
+                spawn_row = rows;
+                spawn_column = j;
             }
         }
+        rows++;
     }
+    fclose(text);
 
-    // Display the current score!
-    char *score = (char*) malloc(sizeof(char) * 4096);
-    sprintf(score, "Score: %d", snek->score);
-    snek_render_text(score, 0, 0, SCREEN_WIDTH/8, (SCREEN_HEIGHT/MAP_COLUMNS)*4);
-    free(score);
-    
-    // Display the results on the screen and return true.
-    SDL_RenderPresent(snek->renderer);
-    return true;
-}
-
-// Render the main menu.
-// Return true on success, and false on failure.
-bool snek_render_menu() {
-    // Return false if the snek global variable pointer does not point to a valid memory location on heap.
-    if (snek == NULL) {
-        printf("snek_render(): Snek global variable pointer is NULL. Returning false.\n");
+    if (rows != MAP_ROWS || spawn_row < 0) {
+        printf("snek_level_convert(): %s needs %d rows and a spawn point. Returning false.\n", text_path, MAP_ROWS);
         return false;
     }
 
-    // Set the screen to dark grey
-    SDL_SetRenderDrawColor(snek->renderer, 32, 32, 32, 0);
-    SDL_RenderClear(snek->renderer);
-
-    // Render the Title
-    snek_render_text("Snek", 0, 0, SCREEN_WIDTH/8, (SCREEN_HEIGHT/MAP_COLUMNS)*4);
+    size_t size = 0;
+    void* data = snek_level_build(walls, spawn_row, spawn_column, &size);
+    if (data == NULL) {
+        printf("snek_level_convert(): snek_level_build() failed. Returning false.\n");
+        return false;
+    }
 
-    // Render the difficulty settings based on difficulty selected.
-    if (snek->difficulty == EASY) {
-        snek_render_text("Difficulty selected: Easy", 0, ((SCREEN_HEIGHT/MAP_COLUMNS)*4), SCREEN_WIDTH/2, (SCREEN_HEIGHT/MAP_COLUMNS)*4);
+    // Check the level the same way it is checked when it is opened, without switching to it.
+    struct snek_level previous = snek_level;
+    bool valid = snek_level_open(data, size, false);
+    snek_level = previous;
+    if (valid == false) {
+        printf("snek_level_convert(): %s is not a valid level. Returning false.\n", text_path);
+        free(data);
+        return false;
     }
 
-    if (snek->difficulty == REGULAR) {
-        snek_render_text("Difficulty selected: Regular", 0, ((SCREEN_HEIGHT/MAP_COLUMNS)*4), SCREEN_WIDTH/2, (SCREEN_HEIGHT/MAP_COLUMNS)*4);
+    uint32_t free_count = ((struct snek_level_header*)data)->free_count;
+    FILE* level = fopen(level_path, "wb");
+    bool written = level != NULL && fwrite(data, 1, size, level) == size;
+    if (level != NULL) {
+        written = fclose(level) == 0 && written;
     }
-    
-    if (snek->difficulty == HARD) {
-        snek_render_text("Difficulty selected: Hard", 0, ((SCREEN_HEIGHT/MAP_COLUMNS)*4), SCREEN_WIDTH/2, (SCREEN_HEIGHT/MAP_COLUMNS)*4);
+    free(data);
+    if (written == false) {
+        printf("snek_level_convert(): Failed to write level file %s. Returning false.\n", level_path);
+        return false;
     }
 
-    snek_render_text("Press E for (E)asy R for (R)egular and Q for (Q)ard) difficulty. Press any other key to start.", 0, ((SCREEN_HEIGHT/MAP_COLUMNS)*4*2), SCREEN_WIDTH, (SCREEN_HEIGHT/MAP_COLUMNS)*4);
-    
-    SDL_RenderPresent(snek->renderer);
+    printf("Wrote %zu byte level with %u free tiles to %s.\n", size, free_count, level_path);
     return true;
 }
 
-// Render the game over screen.
-// Return true on success, and false on failure.
-bool snek_render_game_over() {
-    // Return false if the snek global variable pointer does not point to a valid memory location on heap.
+// Spawn a new instance of a food entity:
+// Ensure it is outside wherever the snek entity exists.
+bool snek_food_entity_spawn() {
+    // Return if the global entity pointer does not point to a valid location on heap.
     if (snek == NULL) {
-        printf("snek_render(): Snek global variable pointer is NULL. Returning false.\n");
+        printf("snek_food_entity_spawn(): Global snek variable is NULL. Returning false.\n");
         return false;
     }
 
-    // Set the screen to dark grey
-    SDL_SetRenderDrawColor(snek->renderer, 32, 32, 32, 0);
-    SDL_RenderClear(snek->renderer);
+    // There is no need to check if the snek entity is NULL or valid.
+    // That is because if it is equal to NULL, then the loop will be executed once and exit.
+    int32_t food_is_inside_snek = 1;
+    struct snek_entity* temp = NULL;
+    
+    // Keep trying to spawn a random location for the food within bounds of the tile map.
+    // Ensure it is outside every node in the snek entity.
 
-    // Render game over.
-    snek_render_text("Game Over!", 0, 0, SCREEN_WIDTH/2, (SCREEN_HEIGHT/MAP_COLUMNS)*4);
+    // If the function is taking too long, then quit after 10 seconds.
+    // This is due to the randomness of trying to find a solution.
+    // This is to prevent the program hanging for too long if something goes wrong.
+    int32_t current_time = SDL_GetTicks();
+    int32_t last_time = current_time;
 
-    // Render final score:
-    char* final_score = (char* )malloc(sizeof(char) * 4096);
-    sprintf(final_score, "Final Score: %d", snek->score);
-    snek_render_text(final_score, 0, ((SCREEN_HEIGHT/MAP_COLUMNS)*4), SCREEN_WIDTH/2, (SCREEN_HEIGHT/MAP_COLUMNS)*4);
-    free(final_score);
+    while (food_is_inside_snek == 1) {
+        food_is_inside_snek = 0;
 
-    // Render difficulty:
-    if (snek->difficulty == EASY) {
-        snek_render_text("Difficulty: Easy", 0, ((SCREEN_HEIGHT/MAP_COLUMNS)*4*2), SCREEN_WIDTH/2, (SCREEN_HEIGHT/MAP_COLUMNS)*4);
-    }
+        // Calculate new food position
+        // Spawn the food on one of the level's free tiles, so it is never inside a wall.
+        uint32_t cell = snek_random(&snek->random_state) % snek_level.header->free_count;
+        snek->food_row = snek_level.free_cells[cell][0];
+        snek->food_column = snek_level.free_cells[cell][1];
 
-    if (snek->difficulty == REGULAR) {
-        snek_render_text("Difficulty: Regular", 0, ((SCREEN_HEIGHT/MAP_COLUMNS)*4*2), SCREEN_WIDTH/2, (SCREEN_HEIGHT/MAP_COLUMNS)*4);
+        // Traverse through the snek entity and every node, from the head for every attempt.
+        // If any node matches the position of the food entity, try again.
+        temp = snek->head;
+        while (temp != NULL) {
+            if (temp->row == snek->food_row && temp->column == snek->food_column) {
+                food_is_inside_snek = 1;
+            }
+            temp = temp->next;
+        }
+
+        // If enough time has elapsed since the loop has been entered, this means the function is taking too long.
+        // Give up trying to search for a new food location and quit the loop.
+        current_time = SDL_GetTicks();
+        if (current_time > last_time + 10000) {
+            printf("snek_food_entity_spawn(): Function is taking too long to find a solution. Returning false.\n");
+            return false;
+        }
     }
 
-    if (snek->difficulty == HARD) {
-        snek_render_text("Difficulty: Hard", 0, ((SCREEN_HEIGHT/MAP_COLUMNS)*4*2), SCREEN_WIDTH/2, (SCREEN_HEIGHT/MAP_COLUMNS)*4);
+    // At this point, a valid food location that isn't intersecting with a snek entity should have been successfully found.
+    // Return true.
+    return true;
+}
+
+// Spawn food for a headless game outside the snek entity.
+// This draws random numbers in exactly the same way as snek_food_entity_spawn(), so both place food in the same locations.
+// Return true on success, and false if there is no free tile.
+bool snek_engine_food_spawn(struct snek_engine* engine) {
+    // Give up straight away if every tile is taken, instead of searching until the timeout.
+    if (engine->length >= (int32_t)snek_level.header->free_count) {
+        return false;
     }
 
-    // Display the results on the screen:
-    SDL_RenderPresent(snek->renderer);
+    do {
+        uint32_t cell = snek_random(&engine->random_state) % snek_level.header->free_count;
+        engine->food_row = snek_level.free_cells[cell][0];
+        engine->food_column = snek_level.free_cells[cell][1];
+    } while (engine->occupied[engine->food_row][engine->food_column] != 0);
 
     return true;
 }
 
-// Update the world and entities.
-// Update entities first, then represent them correctly on the tile map.
-// Return true on success, and false on failure.
-bool snek_update() {
-    // Return false if the snek global variable pointer does not point to a valid memory location on heap.
-    if (snek == NULL) {
-        printf("snek_update(): Snek global variable pointer is NULL. Returning false.\n");
-        return false;
+// Return the Zobrist hash of a headless game, working it out from scratch.
+uint64_t snek_engine_zobrist(struct snek_engine* engine) {
+    int32_t head_row = engine->body_row[engine->head_index];
+    int32_t head_column = engine->body_column[engine->head_index];
+    uint64_t hash = snek_zobrist.head[head_row][head_column] ^ snek_zobrist.direction[engine->direction] ^ snek_zobrist.food[engine->food_row][engine->food_column];
+
+    for (int32_t i = 0; i < engine->length; i++) {
+        int32_t index = (engine->head_index - i + MAP_ROWS * MAP_COLUMNS) % (MAP_ROWS * MAP_COLUMNS);
+        hash ^= snek_zobrist.cell[engine->body_row[index]][engine->body_column[index]];
     }
+    return hash;
+}
 
-    if (snek->head == NULL) {
-        printf("snek_update(): Snek entity is NULL/invalid. Returning false.\n");
+// Work out the Zobrist hash of a headless game from scratch, so it can be updated from then on.
+void snek_engine_zobrist_reset(struct snek_engine* engine) {
+    engine->zobrist = snek_engine_zobrist(engine);
+    engine->zobrist_direction = engine->direction;
+}
+
+// Initialise a headless game as it is at the start of a game, spawning food with the passed in seed.
+void snek_engine_init(struct snek_engine* engine, uint64_t seed) {
+    memset(engine->occupied, 0, sizeof(engine->occupied));
+    engine->head_index = 0;
+    engine->length = 1;
+    engine->body_row[0] = snek_level.header->spawn_row;
+    engine->body_column[0] = snek_level.header->spawn_column;
+    engine->occupied[snek_level.header->spawn_row][snek_level.header->spawn_column] = 1;
+
+    engine->direction = UP;
+    engine->score = 1;
+    engine->status = MID_GAME;
+    engine->random_state = snek_random_seed(seed);
+    snek_engine_food_spawn(engine);
+    snek_engine_zobrist_reset(engine);
+}
+
+// Update a headless game by one tick in constant time.
+// Return true if the game continues, and false if the snek entity hit a wall or itself.
+bool snek_engine_update(struct snek_engine* engine) {
+    int32_t row = engine->body_row[engine->head_index];
+    int32_t column = engine->body_column[engine->head_index];
+
+    // Swap the direction in the hash if it has changed since the last update.
+    engine->zobrist ^= snek_zobrist.direction[engine->zobrist_direction] ^ snek_zobrist.direction[engine->direction];
+    engine->zobrist_direction = engine->direction;
+
+    // Find the new head position, with the same wall check as snek_update().
+    switch (engine->direction) {
+        case UP: row--; break;
+        case DOWN: row++; break;
+        case LEFT: column--; break;
+        case RIGHT: column++; break;
+    }
+    if (snek_level_is_wall(row, column) == true) {
+        engine->status = GAME_OVER;
+        return false;
+    }
+
+    // Move the tail off the map unless food is consumed, before checking if the head runs into the body.
+    bool food_consumed = row == engine->food_row && column == engine->food_column;
+    if (food_consumed == false) {
+        int32_t tail_index = (engine->head_index - engine->length + 1 + MAP_ROWS * MAP_COLUMNS) % (MAP_ROWS * MAP_COLUMNS);
+        engine->occupied[engine->body_row[tail_index]][engine->body_column[tail_index]]--;
+        engine->zobrist ^= snek_zobrist.cell[engine->body_row[tail_index]][engine->body_column[tail_index]];
+        engine->length--;
+    }
+
+    // Add the new head, which like snek_update() happens even if it runs into the body.
+    engine->zobrist ^= snek_zobrist.head[engine->body_row[engine->head_index]][engine->body_column[engine->head_index]];
+    engine->head_index = (engine->head_index + 1) % (MAP_ROWS * MAP_COLUMNS);
+    engine->body_row[engine->head_index] = row;
+    engine->body_column[engine->head_index] = column;
+    engine->length++;
+    engine->occupied[row][column]++;
+    engine->zobrist ^= snek_zobrist.head[row][column] ^ snek_zobrist.cell[row][column];
+    if (engine->occupied[row][column] > 1) {
+        engine->status = GAME_OVER;
+        return false;
+    }
+
+    // Spawn new food and add a point to the score if food was consumed.
+    if (food_consumed == true) {
+        if (snek_engine_food_spawn(engine) == false) {
+            engine->status = GAME_OVER;
+            return false;
+        }
+        engine->zobrist ^= snek_zobrist.food[row][column] ^ snek_zobrist.food[engine->food_row][engine->food_column];
+        engine->score++;
+    }
+
+    return true;
+}
+
+// Return a hash of the state of a headless game.
+// This covers the same state in the same order as snek_hash(), so equal games have equal hashes.
+uint64_t snek_engine_hash(struct snek_engine* engine) {
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    for (int32_t i = 0; i < engine->length; i++) {
+        int32_t index = (engine->head_index - i + MAP_ROWS * MAP_COLUMNS) % (MAP_ROWS * MAP_COLUMNS);
+        hash = snek_hash_mix(hash, engine->body_row[index]);
+        hash = snek_hash_mix(hash, engine->body_column[index]);
+    }
+    hash = snek_hash_mix(hash, engine->direction);
+    hash = snek_hash_mix(hash, engine->food_row);
+    hash = snek_hash_mix(hash, engine->food_column);
+    hash = snek_hash_mix(hash, engine->score);
+    return hash;
+}
+
+// Return true if moving the headless game one tile in the passed in direction would not immediately hit a wall or the snek entity.
+// The tail is treated as staying put, so this can be cautious but is never wrong about a move being safe.
+bool snek_engine_is_safe(struct snek_engine* engine, int32_t direction) {
+    int32_t row = engine->body_row[engine->head_index];
+    int32_t column = engine->body_column[engine->head_index];
+
+    switch (direction) {
+        case UP: row--; break;
+        case DOWN: row++; break;
+        case LEFT: column--; break;
+        case RIGHT: column++; break;
+    }
+
+    if (snek_level_is_wall(row, column) == true) {
+        return false;
+    }
+    return engine->occupied[row][column] == 0;
+}
+
+// Return a direction for a cheap bot to turn a headless game in.
+// Turn towards the food if that is safe, otherwise take a random safe direction, otherwise keep going.
+int32_t snek_engine_greedy_direction(struct snek_engine* engine, uint64_t* random_state) {
+    int32_t row = engine->body_row[engine->head_index];
+    int32_t column = engine->body_column[engine->head_index];
+
+    if (engine->food_row < row && snek_engine_is_safe(engine, UP) == true) {
+        return UP;
+    }
+    if (engine->food_row > row && snek_engine_is_safe(engine, DOWN) == true) {
+        return DOWN;
+    }
+    if (engine->food_column < column && snek_engine_is_safe(engine, LEFT) == true) {
+        return LEFT;
+    }
+    if (engine->food_column > column && snek_engine_is_safe(engine, RIGHT) == true) {
+        return RIGHT;
+    }
+
+    // Try every direction from a random starting point.
+    int32_t start = snek_random(random_state) % 4;
+    for (int32_t i = 0; i < 4; i++) {
+        if (snek_engine_is_safe(engine, (start + i) % 4) == true) {
+            return (start + i) % 4;
+        }
+    }
+    return engine->direction;
+}
+
+// Copy the state of the global snek instance into a headless game.
+void snek_engine_from_snek(struct snek_engine* engine) {
+    memset(engine->occupied, 0, sizeof(engine->occupied));
+
+    // Count the nodes, then place them so that the head ends up at the head index.
+    engine->length = 0;
+    for (struct snek_entity* temp = snek->head; temp != NULL; temp = temp->next) {
+        engine->length++;
+    }
+
+    engine->head_index = engine->length - 1;
+    int32_t index = engine->head_index;
+    for (struct snek_entity* temp = snek->head; temp != NULL; temp = temp->next) {
+        engine->body_row[index] = temp->row;
+        engine->body_column[index] = temp->column;
+        engine->occupied[temp->row][temp->column]++;
+        index--;
+    }
+
+    engine->direction = snek->direction;
+    engine->score = snek->score;
+    engine->status = MID_GAME;
+    engine->food_row = snek->food_row;
+    engine->food_column = snek->food_column;
+    engine->random_state = snek->random_state;
+    engine->zobrist = snek->zobrist;
+    engine->zobrist_direction = snek->zobrist_direction;
+}
+
+// Draw a headless game onto a tile map, the same way snek_update() draws the game's tile map.
+void snek_engine_draw(struct snek_engine* engine, int32_t map[MAP_ROWS][MAP_COLUMNS]) {
+    memcpy(map, snek_level.tiles, sizeof(int32_t) * MAP_ROWS * MAP_COLUMNS);
+    for (int32_t i = 1; i < engine->length; i++) {
+        int32_t index = (engine->head_index - i + MAP_ROWS * MAP_COLUMNS) % (MAP_ROWS * MAP_COLUMNS);
+        map[engine->body_row[index]][engine->body_column[index]] = GREEN;
+    }
+    map[engine->body_row[engine->head_index]][engine->body_column[engine->head_index]] = HEAD;
+    map[engine->food_row][engine->food_column] = RED;
+}
+
+// Play one random game ahead from a snapshot, starting in the passed in direction.
+// Turns are random but avoid immediately fatal moves where possible, and half the time head for the food, and food spawns randomly.
+// Return the value of the rollout, which is a point per tick survived plus more for food the sooner it is eaten.
+int32_t snek_planner_rollout(struct snek_engine* rollout, struct snek_engine* snapshot, int32_t direction, uint64_t* random_state) {
+    memcpy(rollout, snapshot, sizeof(struct snek_engine));
+    rollout->random_state = snek_random_seed(((uint64_t)snek_random(random_state) << 32) | snek_random(random_state));
+    rollout->direction = direction;
+
+    int32_t value = 0;
+    for (int32_t depth = 0; depth < PLANNER_ROLLOUT_DEPTH; depth++) {
+        // Choose a random safe turn after the first move, keeping the current direction if there are none.
+        if (depth > 0) {
+            int32_t row = rollout->body_row[rollout->head_index];
+            int32_t column = rollout->body_column[rollout->head_index];
+            int32_t safe_directions[4];
+            int32_t safe_count = 0;
+            int32_t food_direction = -1;
+            for (int32_t i = 0; i < 4; i++) {
+                if (snek_engine_is_safe(rollout, i) == true) {
+                    safe_directions[safe_count] = i;
+                    safe_count++;
+
+                    if ((i == UP && rollout->food_row < row) || (i == DOWN && rollout->food_row > row) ||
+                        (i == LEFT && rollout->food_column < column) || (i == RIGHT && rollout->food_column > column)) {
+                        food_direction = i;
+                    }
+                }
+            }
+
+            uint32_t choice = snek_random(random_state);
+            if (food_direction >= 0 && (choice & 1) == 0) {
+                rollout->direction = food_direction;
+            } else if (safe_count > 0) {
+                rollout->direction = safe_directions[(choice >> 1) % safe_count];
+            }
+        }
+
+        int32_t score = rollout->score;
+        if (snek_engine_update(rollout) == false) {
+            break;
+        }
+        value += 1;
+        if (rollout->score != score) {
+            value += PLANNER_ROLLOUT_DEPTH - depth;
+        }
+    }
+
+    return value;
+}
+
+// Run rollouts from the planner's snapshot until the deadline, until stopped or until the rollout limit, cycling through every direction.
+// Add the results to the planner's results.
+void snek_planner_work(struct snek_planner* planner, uint64_t deadline, uint64_t rollout_limit, uint64_t seed) {
+    struct snek_engine rollout;
+    uint64_t random_state = snek_random_seed(seed);
+    double value[4] = {0, 0, 0, 0};
+    uint64_t direction_rollouts[4] = {0, 0, 0, 0};
+    uint64_t rollouts = 0;
+    uint64_t start_time = SDL_GetPerformanceCounter();
+    uint64_t current_time = start_time;
+
+    while (current_time < deadline && rollouts < rollout_limit && SDL_AtomicGet(&planner->stop) == 0) {
+        int32_t direction = rollouts % 4;
+        value[direction] += snek_planner_rollout(&rollout, &planner->snapshot, direction, &random_state);
+        direction_rollouts[direction]++;
+        rollouts++;
+        current_time = SDL_GetPerformanceCounter();
+    }
+
+    SDL_LockMutex(planner->mutex);
+    for (int32_t i = 0; i < 4; i++) {
+        planner->value[i] += value[i];
+        planner->direction_rollouts[i] += direction_rollouts[i];
+    }
+    planner->rollouts += rollouts;
+    planner->busy_time += current_time - start_time;
+    SDL_UnlockMutex(planner->mutex);
+}
+
+// Run a planner worker thread.
+// Wait for each new generation of the snapshot, plan from it, then signal when done.
+int snek_planner_thread(void* data) {
+    struct snek_planner* planner = (struct snek_planner*) data;
+    uint32_t generation = 0;
+
+    SDL_LockMutex(planner->mutex);
+    while (true) {
+        while (planner->quit == false && planner->generation == generation) {
+            SDL_CondWait(planner->start_condition, planner->mutex);
+        }
+        if (planner->quit == true) {
+            break;
+        }
+
+        // Give each worker of each generation a different seed, so they do not all play the same rollouts.
+        generation = planner->generation;
+        uint64_t deadline = planner->deadline;
+        uint64_t seed = planner->seed + generation * PLANNER_MAX_THREADS + planner->started;
+        planner->started++;
+        SDL_UnlockMutex(planner->mutex);
+
+        snek_planner_work(planner, deadline, UINT64_MAX, seed);
+
+        SDL_LockMutex(planner->mutex);
+        planner->working--;
+        if (planner->working == 0) {
+            SDL_CondSignal(planner->done_condition);
+        }
+    }
+    SDL_UnlockMutex(planner->mutex);
+
+    return 0;
+}
+
+// Create a planner with a worker thread for each core.
+// If threads are unavailable, the planner falls back to planning on the calling thread.
+// Returns pointer on success, and returns NULL on failure.
+struct snek_planner* snek_planner_new(uint64_t seed) {
+    struct snek_planner* planner = (struct snek_planner*) calloc(1, sizeof(struct snek_planner));
+    if (planner == NULL) {
+        printf("snek_planner_new(): Failed to allocate memory for planner. Returning NULL.\n");
+        return NULL;
+    }
+
+    planner->mutex = SDL_CreateMutex();
+    planner->start_condition = SDL_CreateCond();
+    planner->done_condition = SDL_CreateCond();
+    if (planner->mutex == NULL || planner->start_condition == NULL || planner->done_condition == NULL) {
+        printf("snek_planner_new(): Failed to create planner synchronisation. SDL_GetError(): %s. Returning NULL.\n", SDL_GetError());
+        SDL_DestroyCond(planner->done_condition);
+        SDL_DestroyCond(planner->start_condition);
+        SDL_DestroyMutex(planner->mutex);
+        free(planner);
+        return NULL;
+    }
+    planner->seed = seed;
+
+    // Plan without the cache if there is no memory for it.
+    planner->transpositions = snek_transposition_new(TRANSPOSITION_TABLE_BITS);
+    if (planner->transpositions == NULL) {
+        printf("snek_planner_new(): snek_transposition_new() failed. Planning without a transposition table.\n");
+    }
+
+    int32_t cores = SDL_GetCPUCount();
+    if (cores > PLANNER_MAX_THREADS) {
+        cores = PLANNER_MAX_THREADS;
+    }
+    for (int32_t i = 0; i < cores; i++) {
+        planner->threads[planner->thread_count] = SDL_CreateThread(snek_planner_thread, "snek_planner", planner);
+        if (planner->threads[planner->thread_count] == NULL) {
+            printf("snek_planner_new(): Failed to create planner thread. SDL_GetError(): %s. Planning with %d threads.\n", SDL_GetError(), planner->thread_count);
+            break;
+        }
+        planner->thread_count++;
+    }
+
+    return planner;
+}
+
+// Stop all worker threads and free a planner.
+void snek_planner_free(struct snek_planner* planner) {
+    if (planner == NULL) {
+        return;
+    }
+
+    SDL_AtomicSet(&planner->stop, 1);
+    SDL_LockMutex(planner->mutex);
+    planner->quit = true;
+    SDL_CondBroadcast(planner->start_condition);
+    SDL_UnlockMutex(planner->mutex);
+
+    for (int32_t i = 0; i < planner->thread_count; i++) {
+        SDL_WaitThread(planner->threads[i], NULL);
+    }
+
+    SDL_DestroyCond(planner->done_condition);
+    SDL_DestroyCond(planner->start_condition);
+    SDL_DestroyMutex(planner->mutex);
+    snek_transposition_free(planner->transpositions);
+    free(planner);
+}
+
+// Wait for every worker to finish the current plan.
+// The planner mutex must be locked.
+void snek_planner_wait(struct snek_planner* planner) {
+    while (planner->working > 0) {
+        SDL_CondWait(planner->done_condition, planner->mutex);
+    }
+}
+
+// Start planning in the background from a snapshot of a game, for at most the passed in budget in milliseconds.
+void snek_planner_start(struct snek_planner* planner, struct snek_engine* engine, uint32_t budget) {
+    // Stop any plan still running before overwriting its snapshot.
+    SDL_AtomicSet(&planner->stop, 1);
+    SDL_LockMutex(planner->mutex);
+    snek_planner_wait(planner);
+
+    memcpy(&planner->snapshot, engine, sizeof(struct snek_engine));
+    for (int32_t i = 0; i < 4; i++) {
+        planner->value[i] = 0;
+        planner->direction_rollouts[i] = 0;
+
+        // Start from the rollouts cached for this direction if the state has been planned before.
+        // Entries hold the rollout count in the high half and the average value as a float in the low half.
+        uint64_t data = 0;
+        if (planner->transpositions != NULL && snek_transposition_probe(planner->transpositions, engine->zobrist ^ snek_zobrist.candidate[i], &data) == true) {
+            uint32_t bits = (uint32_t)data;
+            float average = 0;
+            memcpy(&average, &bits, sizeof(float));
+            planner->direction_rollouts[i] = data >> 32;
+            planner->value[i] = average * (double)planner->direction_rollouts[i];
+        }
+    }
+    planner->budget = SDL_GetPerformanceFrequency() * budget / 1000;
+    planner->deadline = SDL_GetPerformanceCounter() + planner->budget;
+    SDL_AtomicSet(&planner->stop, 0);
+
+    if (planner->thread_count > 0) {
+        planner->generation++;
+        planner->started = 0;
+        planner->working = planner->thread_count;
+        SDL_CondBroadcast(planner->start_condition);
+    }
+    SDL_UnlockMutex(planner->mutex);
+}
+
+// Finish the current plan and return the direction with the best average rollout value.
+// When waiting for the deadline, use the whole budget, otherwise stop the workers straight away.
+// Without worker threads, plan on the calling thread instead, for the budget when waiting for the deadline, otherwise for a few rollouts so the caller is not held up.
+int32_t snek_planner_finish(struct snek_planner* planner, bool wait_for_deadline) {
+    if (planner->thread_count == 0) {
+        uint64_t rollout_limit = wait_for_deadline == true ? UINT64_MAX : PLANNER_QUICK_ROLLOUTS;
+        snek_planner_work(planner, SDL_GetPerformanceCounter() + planner->budget, rollout_limit, planner->seed + planner->generation);
+        planner->generation++;
+    }
+
+    if (wait_for_deadline == false) {
+        SDL_AtomicSet(&planner->stop, 1);
+    }
+
+    SDL_LockMutex(planner->mutex);
+    snek_planner_wait(planner);
+
+    // Cache the rollouts for each direction, capping the count so later plans still move the average.
+    if (planner->transpositions != NULL) {
+        for (int32_t i = 0; i < 4; i++) {
+            if (planner->direction_rollouts[i] == 0) {
+                continue;
+            }
+            uint64_t count = planner->direction_rollouts[i];
+            if (count > TRANSPOSITION_MAX_ROLLOUTS) {
+                count = TRANSPOSITION_MAX_ROLLOUTS;
+            }
+            float average = planner->value[i] / planner->direction_rollouts[i];
+            uint32_t bits = 0;
+            memcpy(&bits, &average, sizeof(float));
+            snek_transposition_store(planner->transpositions, planner->snapshot.zobrist ^ snek_zobrist.candidate[i], (count << 32) | bits);
+        }
+    }
+
+    // Keep the current direction unless another direction has a better average.
+    int32_t best_direction = planner->snapshot.direction;
+    double best_value = -1;
+    for (int32_t i = 0; i < 4; i++) {
+        if (planner->direction_rollouts[i] > 0 && planner->value[i] / planner->direction_rollouts[i] > best_value) {
+            best_value = planner->value[i] / planner->direction_rollouts[i];
+            best_direction = i;
+        }
+    }
+    SDL_UnlockMutex(planner->mutex);
+
+    return best_direction;
+}
+
+// Print the rollouts per second per core over every plan so far, then reset the totals.
+void snek_planner_print(struct snek_planner* planner) {
+    SDL_LockMutex(planner->mutex);
+    double busy_seconds = (double)planner->busy_time / (double)SDL_GetPerformanceFrequency();
+    if (busy_seconds > 0) {
+        printf("Planner: %llu rollouts on %d threads, %.0f rollouts/s per core.\n",
+            (unsigned long long)planner->rollouts, planner->thread_count > 0 ? planner->thread_count : 1, planner->rollouts / busy_seconds);
+    }
+    if (planner->transpositions != NULL) {
+        uint64_t probes = atomic_exchange(&planner->transpositions->probes, 0);
+        uint64_t hits = atomic_exchange(&planner->transpositions->hits, 0);
+        if (probes > 0) {
+            printf("Planner: %llu of %llu transposition table probes hit (%.1f%%).\n",
+                (unsigned long long)hits, (unsigned long long)probes, 100.0 * hits / probes);
+        }
+    }
+    planner->rollouts = 0;
+    planner->busy_time = 0;
+    SDL_UnlockMutex(planner->mutex);
+}
+
+// Return the planning budget in milliseconds for a difficulty.
+uint32_t snek_planner_budget(int32_t difficulty) {
+    return difficulty * PLANNER_BUDGET_PERCENT / 100;
+}
+
+// Compare two latency samples for sorting.
+int snek_compare_samples(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a;
+    uint64_t y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+// Call a plugin for the board in its snapshot, recording how long it took.
+// Return the direction it chose.
+// The plugin mutex must be locked, and the plugin is called with it unlocked.
+int32_t snek_plugin_call(struct snek_plugin* plugin) {
+    SDL_UnlockMutex(plugin->mutex);
+    uint64_t start_time = SDL_GetPerformanceCounter();
+    int32_t direction = plugin->direction(&plugin->board);
+    uint64_t end_time = SDL_GetPerformanceCounter();
+    SDL_LockMutex(plugin->mutex);
+
+    plugin->samples[plugin->sample_count % PLUGIN_LATENCY_SAMPLES] = end_time - start_time;
+    plugin->sample_count++;
+    plugin->answer_time = end_time - plugin->start_time;
+    return direction;
+}
+
+// Run a plugin's thread, calling the plugin for each tick it is asked to decide until told to quit.
+int snek_plugin_thread(void* data) {
+    struct snek_plugin* plugin = (struct snek_plugin*) data;
+
+    SDL_LockMutex(plugin->mutex);
+    while (true) {
+        while (plugin->busy == false && plugin->quit == false) {
+            SDL_CondWait(plugin->start_condition, plugin->mutex);
+        }
+        if (plugin->quit == true) {
+            break;
+        }
+
+        // The snapshot is left alone while the plugin is busy, so it can be read without the lock.
+        int32_t direction = snek_plugin_call(plugin);
+
+        plugin->answer = direction;
+        plugin->answered = plugin->requested;
+        plugin->busy = false;
+        SDL_CondSignal(plugin->done_condition);
+    }
+    SDL_UnlockMutex(plugin->mutex);
+
+    return 0;
+}
+
+// Unload a plugin, waiting for its thread to finish any decision it is in the middle of.
+void snek_plugin_free(struct snek_plugin* plugin) {
+    if (plugin == NULL) {
+        return;
+    }
+
+    if (plugin->thread != NULL) {
+        SDL_LockMutex(plugin->mutex);
+        plugin->quit = true;
+        SDL_CondSignal(plugin->start_condition);
+        SDL_UnlockMutex(plugin->mutex);
+        SDL_WaitThread(plugin->thread, NULL);
+    }
+
+    SDL_DestroyCond(plugin->done_condition);
+    SDL_DestroyCond(plugin->start_condition);
+    SDL_DestroyMutex(plugin->mutex);
+    #ifndef __EMSCRIPTEN__
+        if (plugin->library != NULL) {
+            dlclose(plugin->library);
+        }
+    #endif
+    free(plugin);
+}
+
+// Load a plugin from the shared object at the passed in path, and start its thread.
+// If its thread cannot be created, the plugin is called when its decision is needed instead.
+// Shared objects cannot be loaded on the web, so there are never plugins there.
+// Return a pointer on success, and NULL on failure.
+struct snek_plugin* snek_plugin_new(const char* path) {
+#ifdef __EMSCRIPTEN__
+    printf("snek_plugin_new(): Plugins are not available on the web. Returning NULL.\n");
+    return NULL;
+#else
+    struct snek_plugin* plugin = (struct snek_plugin*) calloc(1, sizeof(struct snek_plugin));
+    if (plugin == NULL) {
+        printf("snek_plugin_new(): Failed to allocate memory for plugin. Returning NULL.\n");
+        return NULL;
+    }
+    plugin->path = path;
+
+    plugin->library = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    if (plugin->library == NULL) {
+        printf("snek_plugin_new(): Failed to load plugin %s. dlerror(): %s. Returning NULL.\n", path, dlerror());
+        snek_plugin_free(plugin);
+        return NULL;
+    }
+
+    plugin->direction = (snek_plugin_direction_function) dlsym(plugin->library, SNEK_PLUGIN_DIRECTION_SYMBOL);
+    if (plugin->direction == NULL) {
+        printf("snek_plugin_new(): Plugin %s does not export %s. Returning NULL.\n", path, SNEK_PLUGIN_DIRECTION_SYMBOL);
+        snek_plugin_free(plugin);
+        return NULL;
+    }
+
+    plugin->mutex = SDL_CreateMutex();
+    plugin->start_condition = SDL_CreateCond();
+    plugin->done_condition = SDL_CreateCond();
+    if (plugin->mutex == NULL || plugin->start_condition == NULL || plugin->done_condition == NULL) {
+        printf("snek_plugin_new(): Failed to create plugin synchronisation. SDL_GetError(): %s. Returning NULL.\n", SDL_GetError());
+        snek_plugin_free(plugin);
+        return NULL;
+    }
+
+    plugin->board.rows = MAP_ROWS;
+    plugin->board.columns = MAP_COLUMNS;
+    plugin->board.map = &plugin->map[0][0];
+
+    plugin->thread = SDL_CreateThread(snek_plugin_thread, "snek_plugin", plugin);
+    if (plugin->thread == NULL) {
+        printf("snek_plugin_new(): Failed to create plugin thread. SDL_GetError(): %s. Calling the plugin on the game's thread.\n", SDL_GetError());
+    }
+
+    return plugin;
+#endif
+}
+
+// Ask a plugin to decide the next update from a headless game that has had the passed in number of updates, within the passed in budget in milliseconds.
+// If the plugin is still deciding an earlier tick, this tick is left unanswered and is missed.
+void snek_plugin_start(struct snek_plugin* plugin, struct snek_engine* engine, uint64_t tick, uint32_t budget) {
+    SDL_LockMutex(plugin->mutex);
+    plugin->generation++;
+    if (plugin->busy == true) {
+        SDL_UnlockMutex(plugin->mutex);
+        return;
+    }
+
+    plugin->board.tick = tick;
+    plugin->board.direction = engine->direction;
+    plugin->board.score = engine->score;
+    plugin->board.head_row = engine->body_row[engine->head_index];
+    plugin->board.head_column = engine->body_column[engine->head_index];
+    plugin->board.food_row = engine->food_row;
+    plugin->board.food_column = engine->food_column;
+    snek_engine_draw(engine, plugin->map);
+
+    plugin->requested = plugin->generation;
+    plugin->budget = SDL_GetPerformanceFrequency() * budget / 1000;
+    plugin->start_time = SDL_GetPerformanceCounter();
+    plugin->busy = true;
+    SDL_CondSignal(plugin->start_condition);
+    SDL_UnlockMutex(plugin->mutex);
+}
+
+// Return the direction a plugin decided on for the tick it was last asked about.
+// If it did not answer by the deadline, the miss is recorded and the passed in current direction is kept.
+// Like a keypress, a direction straight back into the snek entity is ignored.
+// The game never waits, while headless games wait for the answer or the deadline, whichever is first.
+int32_t snek_plugin_finish(struct snek_plugin* plugin, int32_t direction, bool wait_for_deadline) {
+    SDL_LockMutex(plugin->mutex);
+
+    // Without a thread, call the plugin now and hold it to the same deadline.
+    // Only the call itself is timed, as the plugin could not start until now.
+    if (plugin->thread == NULL && plugin->busy == true) {
+        plugin->start_time = SDL_GetPerformanceCounter();
+        plugin->answer = snek_plugin_call(plugin);
+        plugin->answered = plugin->requested;
+        plugin->busy = false;
+    }
+
+    while (wait_for_deadline == true && plugin->answered != plugin->generation) {
+        uint64_t elapsed = SDL_GetPerformanceCounter() - plugin->start_time;
+        if (elapsed >= plugin->budget) {
+            break;
+        }
+        uint32_t remaining = (plugin->budget - elapsed) * 1000 / SDL_GetPerformanceFrequency() + 1;
+        SDL_CondWaitTimeout(plugin->done_condition, plugin->mutex, remaining);
+    }
+
+    plugin->decisions++;
+    if (plugin->answered != plugin->generation || plugin->answer_time > plugin->budget || plugin->answer < UP || plugin->answer > RIGHT) {
+        plugin->misses++;
+    } else if (plugin->answer != (direction ^ 1)) {
+        direction = plugin->answer;
+    }
+    SDL_UnlockMutex(plugin->mutex);
+
+    return direction;
+}
+
+// Wait for a plugin to finish any decision it is in the middle of.
+void snek_plugin_wait(struct snek_plugin* plugin) {
+    SDL_LockMutex(plugin->mutex);
+    while (plugin->thread != NULL && plugin->busy == true) {
+        SDL_CondWait(plugin->done_condition, plugin->mutex);
+    }
+    SDL_UnlockMutex(plugin->mutex);
+}
+
+// Print a plugin's decision latency percentiles over its recent decisions, and how many ticks it missed, then clear them.
+void snek_plugin_print(struct snek_plugin* plugin) {
+    SDL_LockMutex(plugin->mutex);
+    uint64_t count = plugin->sample_count < PLUGIN_LATENCY_SAMPLES ? plugin->sample_count : PLUGIN_LATENCY_SAMPLES;
+    if (count > 0) {
+        uint64_t* samples = (uint64_t*) malloc(sizeof(uint64_t) * count);
+        if (samples != NULL) {
+            memcpy(samples, plugin->samples, sizeof(uint64_t) * count);
+            qsort(samples, count, sizeof(uint64_t), snek_compare_samples);
+            double to_microseconds = 1000000.0 / (double)SDL_GetPerformanceFrequency();
+            printf("Plugin %s decision latency over %llu decisions: p50 %.1fus p90 %.1fus p99 %.1fus max %.1fus\n", plugin->path, (unsigned long long)count,
+                samples[count / 2] * to_microseconds, samples[count * 90 / 100] * to_microseconds,
+                samples[count * 99 / 100] * to_microseconds, samples[count - 1] * to_microseconds);
+            free(samples);
+        }
+    }
+    printf("Plugin %s missed the deadline for %llu of %llu ticks.\n", plugin->path, (unsigned long long)plugin->misses, (unsigned long long)plugin->decisions);
+    plugin->sample_count = 0;
+    plugin->decisions = 0;
+    plugin->misses = 0;
+    SDL_UnlockMutex(plugin->mutex);
+}
+
+// Return the budget in milliseconds plugins have to decide each update at a difficulty.
+uint32_t snek_plugin_budget(int32_t difficulty) {
+    return difficulty * PLUGIN_BUDGET_PERCENT / 100;
+}
+
+// Ask the game's plugin to decide the next update from the current state of the game.
+void snek_plugin_start_game() {
+    struct snek_engine engine;
+    snek_engine_from_snek(&engine);
+    snek_plugin_start(snek->plugin, &engine, snek->ticks, snek_plugin_budget(snek->difficulty));
+}
+
+// Initialise the TTF engine and load the font.
+// Use the font compiled into the program if there is one, otherwise open it relative to the program, then relative to the working directory.
+// Return true on success, and false on failure.
+bool snek_font_load() {
+    // Don't try again if loading the font has already failed.
+    if (snek->font_failed == true) {
+        return false;
+    }
+
+    uint64_t start_time = SDL_GetPerformanceCounter();
+
+    // Initialise TTF Engine:
+    if (TTF_Init() != 0) {
+        printf("snek_font_load(): Failed to intialise TTF rendering engine. Returning false.\n");
+        snek->font_failed = true;
+        return false;
+    }
+
+    // Open TTF font.
+    #ifdef SNEK_EMBEDDED_FONT
+        SDL_RWops* font_data = SDL_RWFromConstMem(third_party_roboto_mono_RobotoMono_Bold_ttf, third_party_roboto_mono_RobotoMono_Bold_ttf_len);
+        snek->font = TTF_OpenFontRW(font_data, 1, FONT_SIZE);
+    #else
+        char* base_path = SDL_GetBasePath();
+        if (base_path != NULL) {
+            char font_path[4096];
+            snprintf(font_path, sizeof(font_path), "%s%s", base_path, FONT_PATH);
+            snek->font = TTF_OpenFont(font_path, FONT_SIZE);
+            SDL_free(base_path);
+        }
+        if (snek->font == NULL) {
+            snek->font = TTF_OpenFont(FONT_PATH, FONT_SIZE);
+        }
+    #endif
+
+    if (snek->font == NULL) {
+        printf("snek_font_load(): Failed to open TTF font. Returning false.\n");
+        TTF_Quit();
+        snek->font_failed = true;
+        return false;
+    }
+
+    printf("Font loaded in %.2fms.\n", (double)(SDL_GetPerformanceCounter() - start_time) * 1000.0 / (double)SDL_GetPerformanceFrequency());
+    return true;
+}
+
+// Display the results on the screen.
+// Print the time to first frame since main() started the first time this is called.
+void snek_render_present() {
+    SDL_RenderPresent(snek->renderer);
+
+    if (snek->first_frame_presented == false) {
+        snek->first_frame_presented = true;
+        printf("Time to first frame since main() started: %.2fms.\n", (double)(SDL_GetPerformanceCounter() - snek->launch_time) * 1000.0 / (double)SDL_GetPerformanceFrequency());
+    }
+}
+
+// Destroy the cached glyph textures, so they are rendered again the next time text is drawn.
+void snek_glyphs_free() {
+    for (int32_t i = 0; i < GLYPH_COUNT; i++) {
+        if (snek->glyphs[i] != NULL) {
+            SDL_DestroyTexture(snek->glyphs[i]);
+            snek->glyphs[i] = NULL;
+        }
+    }
+    snek->glyphs_ready = false;
+}
+
+// Render a texture for every printable character with the loaded font.
+// Characters that render nothing, like spaces, keep their width with no texture.
+void snek_glyphs_init() {
+    SDL_Color white = {255, 255, 255};
+    for (int32_t i = 0; i < GLYPH_COUNT; i++) {
+        char glyph[2] = {(char)(GLYPH_FIRST + i), '\0'};
+        int32_t height = 0;
+        TTF_SizeText(snek->font, glyph, &snek->glyph_widths[i], &height);
+
+        SDL_Surface* glyph_surface = TTF_RenderText_Solid(snek->font, glyph, white);
+        if (glyph_surface != NULL) {
+            snek->glyph_widths[i] = glyph_surface->w;
+            snek->glyphs[i] = SDL_CreateTextureFromSurface(snek->renderer, glyph_surface);
+            SDL_FreeSurface(glyph_surface);
+        }
+    }
+    snek->glyphs_ready = true;
+}
+
+// Render text to location on renderer:
+// The text is stretched to fill the passed in rectangle, drawing each character from the glyph cache.
+bool snek_render_text(char* text, int32_t x, int32_t y, int32_t w, int32_t h) {
+    // Return if the global entity pointer does not point to a valid location on heap.
+    if (snek == NULL) {
+        printf("snek_food_entity_spawn(): Global snek variable is NULL. Returning false.\n");
+        return false;
+    }
+
+    if (text == NULL) {
+        printf("snek_food_entity_spawn(): Invalid text pointer. Returning false.\n");
+        return false;
+    }
+
+    // Load the font the first time text is rendered.
+    if (snek->font == NULL && snek_font_load() == false) {
+        return false;
+    }
+
+    // Render the glyphs the first time text is drawn, and after the renderer loses them.
+    if (snek->glyphs_ready == false) {
+        snek_glyphs_init();
+    }
+
+    // Find the width of the whole text, to share the rectangle out between its characters.
+    int32_t text_width = 0;
+    for (char* c = text; *c != '\0'; c++) {
+        if (*c >= GLYPH_FIRST && *c < GLYPH_FIRST + GLYPH_COUNT) {
+            text_width += snek->glyph_widths[*c - GLYPH_FIRST];
+        }
+    }
+    if (text_width == 0) {
+        return true;
+    }
+
+    // Copy each character's glyph to the renderer, in the part of the rectangle it would take up if the whole text was stretched to fill it.
+    int32_t offset = 0;
+    for (char* c = text; *c != '\0'; c++) {
+        if (*c < GLYPH_FIRST || *c >= GLYPH_FIRST + GLYPH_COUNT) {
+            continue;
+        }
+        int32_t glyph = *c - GLYPH_FIRST;
+
+        SDL_Rect text_rect;
+        text_rect.x = x + (int32_t)((int64_t)w * offset / text_width);
+        text_rect.y = y;
+        text_rect.w = x + (int32_t)((int64_t)w * (offset + snek->glyph_widths[glyph]) / text_width) - text_rect.x;
+        text_rect.h = h;
+        if (snek->glyphs[glyph] != NULL) {
+            SDL_RenderCopy(snek->renderer, snek->glyphs[glyph], NULL, &text_rect);
+        }
+        offset += snek->glyph_widths[glyph];
+    }
+
+    return true;
+}
+
+// Open a shared memory control channel with the passed in name, creating it if asked to, or else attaching to one the game created.
+// Creating fails if the name is already taken, so a second game never wipes out a channel in use.
+// Shared memory is not available on the web, so there are never channels there.
+// Return a pointer to the mapped channel on success, and NULL on failure.
+struct snek_channel* snek_channel_open(const char* name, bool create) {
+#ifdef __EMSCRIPTEN__
+    printf("snek_channel_open(): Control channels are not available on the web. Returning NULL.\n");
+    return NULL;
+#else
+    int fd = shm_open(name, create ? O_CREAT | O_EXCL | O_RDWR : O_RDWR, 0600);
+    if (fd < 0 && create == true && errno == EEXIST) {
+        printf("snek_channel_open(): Shared memory %s is already in use by another game. If no game is using it, remove it from /dev/shm. Returning NULL.\n", name);
+        return NULL;
+    }
+    if (fd < 0) {
+        printf("snek_channel_open(): Failed to open shared memory %s. Returning NULL.\n", name);
+        return NULL;
+    }
+
+    struct stat file_status;
+    if ((create == true && ftruncate(fd, sizeof(struct snek_channel)) != 0)
+        || fstat(fd, &file_status) != 0 || file_status.st_size < (off_t)sizeof(struct snek_channel)) {
+        printf("snek_channel_open(): Shared memory %s is not the size of a channel. Returning NULL.\n", name);
+        close(fd);
+        if (create == true) {
+            shm_unlink(name);
+        }
+        return NULL;
+    }
+
+    struct snek_channel* channel = (struct snek_channel*) mmap(NULL, sizeof(struct snek_channel), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (channel == MAP_FAILED) {
+        printf("snek_channel_open(): Failed to map shared memory %s. Returning NULL.\n", name);
+        if (create == true) {
+            shm_unlink(name);
+        }
+        return NULL;
+    }
+
+    if (create == true) {
+        memset(channel, 0, sizeof(struct snek_channel));
+        channel->version = CHANNEL_VERSION;
+        channel->rows = MAP_ROWS;
+        channel->columns = MAP_COLUMNS;
+        memcpy(channel->magic, CHANNEL_MAGIC, 8);
+    } else if (memcmp(channel->magic, CHANNEL_MAGIC, 8) != 0 || channel->version != CHANNEL_VERSION || channel->rows != MAP_ROWS || channel->columns != MAP_COLUMNS) {
+        printf("snek_channel_open(): Shared memory %s is not a channel for %dx%d maps. Returning NULL.\n", name, MAP_ROWS, MAP_COLUMNS);
+        munmap(channel, sizeof(struct snek_channel));
+        return NULL;
+    }
+
+    return channel;
+#endif
+}
+
+// Close a shared memory control channel, removing its name if it was created by this process.
+void snek_channel_close(struct snek_channel* channel, const char* name) {
+    if (channel == NULL) {
+        return;
+    }
+    munmap(channel, sizeof(struct snek_channel));
+    #ifndef __EMSCRIPTEN__
+        if (name != NULL) {
+            shm_unlink(name);
+        }
+    #endif
+}
+
+// Start writing the board, so readers retry until it is finished with snek_channel_publish_end().
+void snek_channel_publish_begin(struct snek_channel* channel) {
+    uint64_t sequence = atomic_load_explicit(&channel->sequence, memory_order_relaxed);
+    atomic_store_explicit(&channel->sequence, sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+}
+
+// Finish writing the board, publishing it to readers.
+void snek_channel_publish_end(struct snek_channel* channel) {
+    uint64_t sequence = atomic_load_explicit(&channel->sequence, memory_order_relaxed);
+    atomic_store_explicit(&channel->sequence, sequence + 1, memory_order_release);
+}
+
+// Copy a consistent snapshot of the board, retrying while the game is writing it.
+// Yield the core now and then while waiting, in case the game is waiting for it to finish writing.
+// Return the sequence number of the snapshot, which changes every time the board is published.
+uint64_t snek_channel_read(struct snek_channel* channel, struct snek_channel_board* board) {
+    int32_t spins = 0;
+    while (true) {
+        uint64_t sequence = atomic_load_explicit(&channel->sequence, memory_order_acquire);
+        if (sequence % 2 == 1) {
+            if (++spins == CHANNEL_SPIN_LIMIT) {
+                spins = 0;
+                sched_yield();
+            }
+            continue;
+        }
+        memcpy(board, &channel->board, sizeof(struct snek_channel_board));
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&channel->sequence, memory_order_relaxed) == sequence) {
+            return sequence;
+        }
+    }
+}
+
+// Publish the state of the game to the control channel.
+void snek_channel_publish() {
+    if (snek->channel == NULL) {
+        return;
+    }
+
+    snek_channel_publish_begin(snek->channel);
+    struct snek_channel_board* board = &snek->channel->board;
+    board->tick = snek->ticks;
+    board->status = snek->status;
+    board->direction = snek->direction;
+    board->score = snek->score;
+    board->head_row = snek->head->row;
+    board->head_column = snek->head->column;
+    board->food_row = snek->food_row;
+    board->food_column = snek->food_column;
+    memcpy(board->map, snek->map, sizeof(board->map));
+    snek_channel_publish_end(snek->channel);
+}
+
+// Take the direction a bot wrote to the control channel, if there is one, right before an update.
+// Only a direction answering the board last published is taken, so a late answer to an older board is dropped.
+// Like a keypress, a direction straight back into the snek entity is ignored.
+void snek_channel_consume() {
+    if (snek->channel == NULL) {
+        return;
+    }
+
+    uint64_t command = atomic_exchange_explicit(&snek->channel->command, 0, memory_order_acquire);
+    if ((command >> 8) != snek->ticks + 1) {
+        return;
+    }
+    int32_t direction = command & 0xFF;
+    if (direction < 4 && direction != (snek->direction ^ 1)) {
+        snek->direction = direction;
+    }
+}
+
+// Initialise the tile map that is the world that the entities reside/exist in.
+bool snek_map_init() {
+    // Return failure if the global entity pointer does not point to a valid location on heap.
+    if (snek == NULL) {
+        printf("snek_map_init(): Snek global variable is NULL. Returning false.\n");
+        return false;
+    }
+
+    // Copy the level's tile map, which has its walls set to grey and every other tile set to black.
+    memcpy(snek->map, snek_level.tiles, sizeof(snek->map));
+
+    // Return success.
+    return true;
+}
+
+// Put back the level's tiles under the snek entity and food, leaving the tile map as snek_map_init() sets it.
+// This only touches the tiles that were drawn over, instead of the whole map every update.
+void snek_map_clear() {
+    for (struct snek_entity* temp = snek->head; temp != NULL; temp = temp->next) {
+        snek->map[temp->row][temp->column] = snek_level.tiles[temp->row][temp->column];
+    }
+    snek->map[snek->food_row][snek->food_column] = snek_level.tiles[snek->food_row][snek->food_column];
+}
+
+// Return the Zobrist hash of the game, working it out from scratch.
+uint64_t snek_zobrist_hash() {
+    uint64_t hash = snek_zobrist.head[snek->head->row][snek->head->column] ^ snek_zobrist.direction[snek->direction] ^ snek_zobrist.food[snek->food_row][snek->food_column];
+    for (struct snek_entity* temp = snek->head; temp != NULL; temp = temp->next) {
+        hash ^= snek_zobrist.cell[temp->row][temp->column];
+    }
+    return hash;
+}
+
+// Work out the Zobrist hash of the game from scratch, so snek_update() can update it from then on.
+void snek_zobrist_reset() {
+    snek->zobrist = snek_zobrist_hash();
+    snek->zobrist_direction = snek->direction;
+}
+
+// Initialise the global snek instance:
+// Return true on success, and false on failure.
+bool snek_init() {
+    // Set the snek pointer global variable to point to a valid allocated chunk of memory in the heap.
+    // Return on failure to do so.
+    snek = (struct snek*) malloc(sizeof(struct snek));
+    if (snek == NULL) {
+        printf("snek_init(): Malloc failed when trying to assign memory to snek global pointer. Returning false.\n");
+        return false;
+    }
+    snek->launch_time = snek_launch_time;
+
+    // Fill the entity pool, so the snek entity never allocates while playing.
+    snek_entity_pool_init();
+
+    // Attempt to initialise SDL.
+    // // Return failure on failure to do so and free all allocated resources.
+    if (SDL_Init(SDL_INIT_VIDEO) != 0) {
+        printf("snek_init(): Failed to initialise SDL. SDL_GetError(): %s. Returning false.\n", SDL_GetError());
+        free(snek);
+        snek = NULL;
+        return false;
+    }
+
+    // Attempt to initialise SDL Window.
+    // // Return failure on failure to do so and free all allocated resources.
+    snek->window = SDL_CreateWindow("Snek", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, SCREEN_WIDTH, SCREEN_HEIGHT, SDL_WINDOW_SHOWN);
+    if (snek->window == NULL) {
+        printf("snek_init(): Failed to initialise SDL Window. SDL_GetError(): %s. Returning false.\n", SDL_GetError());
+        SDL_Quit();
+        free(snek);
+        snek = NULL;
+        return false;
+    }
+
+    // Attempt to initialise SDL Renderer. 
+    // Return failure on failure to do so and free all allocated resources.
+    snek->renderer = SDL_CreateRenderer(snek->window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
+    if (snek->renderer == NULL) {
+        printf("snek_init(): Failed to initialise SDL Window. SDL_GetError(): %s. Returning false.\n", SDL_GetError());
+        SDL_DestroyWindow(snek->window);
+        SDL_Quit();
+        free(snek);
+        snek = NULL;
+        return false;
+    }
+
+    // Attempt to initialise snek entity. 
+    // Return failure on failure to do so and free all allocated resources.
+    // Spawn the snek entity in the middle of the map or screen.
+    snek->head = snek_entity_new(snek_level.header->spawn_row, snek_level.header->spawn_column);
+    if (snek->head == NULL) {
+        printf("snek_init(): snek_entity_new() failed to create snek entity for program. Returning false.\n");
+        SDL_DestroyRenderer(snek->renderer);
+        SDL_DestroyWindow(snek->window);
+        SDL_Quit();
+        free(snek);
+        snek = NULL;
+        return false;
+    }
+
+    // Initialise the tile map.
+    // Return failure on failure to do so and free all allocated resources.
+    if (snek_map_init() == false) {
+        printf("snek_init(): snek_map_init() failed to initialise map for program. Returning false.\n");
+        SDL_DestroyRenderer(snek->renderer);
+        SDL_DestroyWindow(snek->window);
+        SDL_Quit();
+        snek_entity_free(snek->head);
+        free(snek);
+        snek = NULL;
+        return false;        
+    }
+
+    // Spawn the food in a random unique location away from the snek entity
+    // Return failure on failure to do so and free all allocated resources.
+    snek->random_state = snek_random_seed(time(0));
+    if (snek_food_entity_spawn() == false) {
+        printf("snek_init(): snek_food_entity_spawn() failed to find food spawn location for program. Returning false.\n");
+        SDL_DestroyRenderer(snek->renderer);
+        SDL_DestroyWindow(snek->window);
+        SDL_Quit();
+        snek_entity_free(snek->head);
+        free(snek);
+        snek = NULL;
+        return false;    
+    }
+
+    // The font and TTF engine are not loaded until text is first rendered, to get to the first frame sooner.
+    snek->font = NULL;
+    snek->font_failed = false;
+    snek->first_frame_presented = false;
+
+    // Screens are composed the first time they are shown.
+    for (int32_t i = 0; i < SCREEN_COUNT; i++) {
+        snek->screens[i] = NULL;
+        snek->screen_dirty[i] = true;
+    }
+    snek->screen_shown = SCREEN_NONE;
+    snek->screen_targets_failed = false;
+    snek->interpolation = 1;
+
+    // Glyphs are rendered the first time text is drawn.
+    for (int32_t i = 0; i < GLYPH_COUNT; i++) {
+        snek->glyphs[i] = NULL;
+        snek->glyph_widths[i] = 0;
+    }
+    snek->glyphs_ready = false;
+
+    // Assign a default direction for the snek entity.
+    // This is just an initialisation step, in practise a user's input will be what is assigned.
+    snek->direction = UP;
+
+    // The first game starts without a reset, so work out its Zobrist hash now the snek entity, food and direction are in place.
+    snek_zobrist_reset();
+
+    // Set the program status to start, which means that it will wait for user input before beginning the gameplay.
+    snek->status = START_MENU;
+
+    // Initialise timer.
+    snek->last_time = 0;
+    snek->accumulator = 0;
+    snek->game_time = 0;
+    snek->ticks = 0;
+    snek->ticks_dropped = 0;
+
+    // Initialise score:
+    snek->score = 1;
+
+    // Initialise Difficulty:
+    snek->difficulty = REGULAR;
+
+    // Initialise input latency measurement, with input sampled every loop pass by default.
+    snek_latency_reset(&snek->latency);
+    snek->late_latch = false;
+
+    // Initialise the autopilot as off. The planner is only created once it is turned on.
+    snek->planner = NULL;
+    snek->autopilot = false;
+
+    // Initialise with no spectator wall, which is only used when asked for on the command line.
+    snek->spectator = NULL;
+
+    // Initialise with no control channel, which is only opened when asked for on the command line.
+    snek->channel = NULL;
+    snek->channel_name = NULL;
+
+    // Initialise with no controller plugin, which is only loaded when asked for on the command line.
+    snek->plugin = NULL;
+
+    // Return true if all initialisation steps have succeeded.
+    return true;
+}
+
+// Initialise the global snek instance without SDL, for running games headless.
+// Return true on success, and false on failure.
+bool snek_headless_init() {
+    // Allocate the snek global variable with everything zeroed, so SDL data is NULL.
+    snek = (struct snek*) calloc(1, sizeof(struct snek));
+    if (snek == NULL) {
+        printf("snek_headless_init(): Calloc failed when trying to assign memory to snek global pointer. Returning false.\n");
+        return false;
+    }
+    snek_entity_pool_init();
+
+    snek->direction = UP;
+    snek->status = MID_GAME;
+    snek->difficulty = REGULAR;
+    snek->random_state = snek_random_seed(0);
+
+    // Return true if all initialisation steps have succeeded.
+    return true;
+}
+
+// Free all memory allocated to a headless snek instance on heap.
+void snek_headless_quit() {
+    if (snek == NULL) {
+        return;
+    }
+
+    if (snek->head != NULL) {
+        snek_entity_free(snek->head);
+    }
+    free(snek);
+    snek = NULL;
+}
+
+// Quit SDL and free all memory allocated to snek on heap.
+// Return true on success, and false on failure.
+bool snek_quit() {
+    // Return false if the global variable snek pointer is set to NULL.
+    if (snek == NULL) {
+        printf("snek_quit(): Snek global variable is equal to NULL. Returning false.\n");
+        return false;
+    }
+
+    // Stop the autopilot planner's and plugin's threads before quitting SDL.
+    snek_planner_free(snek->planner);
+    snek_plugin_free(snek->plugin);
+
+    // Tell bots the game has quit, then remove the control channel.
+    if (snek->channel != NULL) {
+        snek->status = QUIT_LOOP;
+        snek_channel_publish();
+        snek_channel_close(snek->channel, snek->channel_name);
+    }
+
+    // Close the font and quit TTF renderer, if text was ever rendered, before quitting SDL.
+    if (snek->font != NULL) {
+        TTF_CloseFont(snek->font);
+        TTF_Quit();
+    }
+
+    // Free resources associated with SDL and quit SDL.
+    snek_glyphs_free();
+    for (int32_t i = 0; i < SCREEN_COUNT; i++) {
+        if (snek->screens[i] != NULL) {
+            SDL_DestroyTexture(snek->screens[i]);
+        }
+    }
+    SDL_DestroyRenderer(snek->renderer);
+    SDL_DestroyWindow(snek->window);
+    SDL_Quit();
+
+    // Free all memory assigned to snek entity.
+    if (snek->head != NULL) {
+        snek_entity_free(snek->head);
+    }
+
+    // Unmap or free the level.
+    snek_level_close();
+
+    // Free the snek global variable from the heap.
+    free(snek);
+
+    // Return true.
+    return true;
+}
+
+// Draw the tilemap without displaying it.
+// The interpolation is how far between the last update and the next one the frame is, from 0 to 1.
+// The head and tail are drawn that far along their movement, so motion is smooth at any display rate.
+// Return true on success, and false on failure.
+bool snek_render_game(float interpolation) {
+    // Return false if the snek global variable pointer does not point to a valid memory location on heap.
+    if (snek == NULL) {
+        printf("snek_render(): Snek global variable pointer is NULL. Returning false.\n");
+        return false;
+    }
+
+    // Set the screen to grey.
+    SDL_SetRenderDrawColor(snek->renderer, 32, 32, 32, 0);
+    SDL_RenderClear(snek->renderer);
+
+    // Initialise a rect for SDL to draw with, with appropriate position and dimensions
+    SDL_Rect render_rect;
+    render_rect.w = SCREEN_WIDTH/MAP_COLUMNS;
+    render_rect.h = SCREEN_HEIGHT/MAP_ROWS;
+    render_rect.x = 0;
+    render_rect.y = 0;
+
+    // Traverse through the tile map.
+    // Get the render colour and calculate position to draw a tile of said colour and draw it for each tile.
+    for (int32_t i=0; i < MAP_ROWS; i++) {
+        for (int32_t j=0; j < MAP_COLUMNS; j++) {
+            render_rect.x = j * render_rect.w;
+            render_rect.y = i * render_rect.h;
+
+            const uint8_t* colour = snek_tile_colours[snek->map[i][j]];
+            SDL_SetRenderDrawColor(snek->renderer, colour[0], colour[1], colour[2], 0);
+            SDL_RenderFillRect(snek->renderer, &render_rect);
+        }
+    }
+
+    // Draw the head and tail between their positions before and after the last update.
+    // The head tile has not been reached yet so it is covered, and the vacated tail tile is still partly occupied.
+    // This is skipped until there has been an update, and once the game is over.
+    if (snek->ticks > 0 && snek->status == MID_GAME) {
+        render_rect.x = snek->head->column * render_rect.w;
+        render_rect.y = snek->head->row * render_rect.h;
+        SDL_SetRenderDrawColor(snek->renderer, snek_tile_colours[BLACK][0], snek_tile_colours[BLACK][1], snek_tile_colours[BLACK][2], 0);
+        SDL_RenderFillRect(snek->renderer, &render_rect);
+
+        render_rect.x = (int32_t)((snek->previous_tail_column + (snek->tail_column - snek->previous_tail_column) * interpolation) * render_rect.w);
+        render_rect.y = (int32_t)((snek->previous_tail_row + (snek->tail_row - snek->previous_tail_row) * interpolation) * render_rect.h);
+        SDL_SetRenderDrawColor(snek->renderer, snek_tile_colours[GREEN][0], snek_tile_colours[GREEN][1], snek_tile_colours[GREEN][2], 0);
+        SDL_RenderFillRect(snek->renderer, &render_rect);
+
+        render_rect.x = (int32_t)((snek->previous_head_column + (snek->head->column - snek->previous_head_column) * interpolation) * render_rect.w);
+        render_rect.y = (int32_t)((snek->previous_head_row + (snek->head->row - snek->previous_head_row) * interpolation) * render_rect.h);
+        SDL_SetRenderDrawColor(snek->renderer, snek_tile_colours[HEAD][0], snek_tile_colours[HEAD][1], snek_tile_colours[HEAD][2], 0);
+        SDL_RenderFillRect(snek->renderer, &render_rect);
+    }
+
+    // Display the current score!
+    char score[32];
+    snprintf(score, sizeof(score), "Score: %d", snek->score);
+    snek_render_text(score, 0, 0, SCREEN_WIDTH/8, (SCREEN_HEIGHT/MAP_COLUMNS)*4);
+
+    return true;
+}
+
+// Render the tilemap onto the screen.
+// Return true on success, and false on failure.
+bool snek_render(float interpolation) {
+    if (snek_render_game(interpolation) == false) {
+        return false;
+    }
+    snek->interpolation = interpolation;
+
+    // Display the results on the screen and return true.
+    // Any input applied by the last update is now visible, so record its latency.
+    // The display no longer shows any cached screen.
+    snek_render_present();
+    snek_latency_present(&snek->latency, SDL_GetTicks());
+    snek->screen_shown = SCREEN_NONE;
+    return true;
+}
+
+// Compose the main menu onto the current render target.
+// Return true on success, and false on failure.
+bool snek_compose_menu() {
+    // Return false if the snek global variable pointer does not point to a valid memory location on heap.
+    if (snek == NULL) {
+        printf("snek_compose_menu(): Snek global variable pointer is NULL. Returning false.\n");
+        return false;
+    }
+
+    // Set the screen to dark grey
+    SDL_SetRenderDrawColor(snek->renderer, 32, 32, 32, 0);
+    SDL_RenderClear(snek->renderer);
+
+    // Render the Title
+    snek_render_text("Snek", 0, 0, SCREEN_WIDTH/8, (SCREEN_HEIGHT/MAP_COLUMNS)*4);
+
+    // Render the difficulty settings based on difficulty selected.
+    if (snek->difficulty == EASY) {
+        snek_render_text("Difficulty selected: Easy", 0, ((SCREEN_HEIGHT/MAP_COLUMNS)*4), SCREEN_WIDTH/2, (SCREEN_HEIGHT/MAP_COLUMNS)*4);
+    }
+
+    if (snek->difficulty == REGULAR) {
+        snek_render_text("Difficulty selected: Regular", 0, ((SCREEN_HEIGHT/MAP_COLUMNS)*4), SCREEN_WIDTH/2, (SCREEN_HEIGHT/MAP_COLUMNS)*4);
+    }
+    
+    if (snek->difficulty == HARD) {
+        snek_render_text("Difficulty selected: Hard", 0, ((SCREEN_HEIGHT/MAP_COLUMNS)*4), SCREEN_WIDTH/2, (SCREEN_HEIGHT/MAP_COLUMNS)*4);
+    }
+
+    snek_render_text("Press E for (E)asy R for (R)egular and Q for (Q)ard) difficulty. Press any other key to start.", 0, ((SCREEN_HEIGHT/MAP_COLUMNS)*4*2), SCREEN_WIDTH, (SCREEN_HEIGHT/MAP_COLUMNS)*4);
+
+    // Render the input latching setting.
+    if (snek->late_latch == true) {
+        snek_render_text("Press L to toggle (L)ate input latching: On", 0, ((SCREEN_HEIGHT/MAP_COLUMNS)*4*3), SCREEN_WIDTH/2, (SCREEN_HEIGHT/MAP_COLUMNS)*4);
+    } else {
+        snek_render_text("Press L to toggle (L)ate input latching: Off", 0, ((SCREEN_HEIGHT/MAP_COLUMNS)*4*3), SCREEN_WIDTH/2, (SCREEN_HEIGHT/MAP_COLUMNS)*4);
+    }
+
+    // Render the autopilot setting.
+    if (snek->autopilot == true) {
+        snek_render_text("Press O to toggle aut(O)pilot: On", 0, ((SCREEN_HEIGHT/MAP_COLUMNS)*4*4), SCREEN_WIDTH/2, (SCREEN_HEIGHT/MAP_COLUMNS)*4);
+    } else {
+        snek_render_text("Press O to toggle aut(O)pilot: Off", 0, ((SCREEN_HEIGHT/MAP_COLUMNS)*4*4), SCREEN_WIDTH/2, (SCREEN_HEIGHT/MAP_COLUMNS)*4);
+    }
+
+    return true;
+}
+
+// Compose the game over screen onto the current render target.
+// Return true on success, and false on failure.
+bool snek_compose_game_over() {
+    // Return false if the snek global variable pointer does not point to a valid memory location on heap.
+    if (snek == NULL) {
+        printf("snek_compose_game_over(): Snek global variable pointer is NULL. Returning false.\n");
+        return false;
+    }
+
+    // Set the screen to dark grey
+    SDL_SetRenderDrawColor(snek->renderer, 32, 32, 32, 0);
+    SDL_RenderClear(snek->renderer);
+
+    // Render game over.
+    snek_render_text("Game Over!", 0, 0, SCREEN_WIDTH/2, (SCREEN_HEIGHT/MAP_COLUMNS)*4);
+
+    // Render final score:
+    char final_score[32];
+    snprintf(final_score, sizeof(final_score), "Final Score: %d", snek->score);
+    snek_render_text(final_score, 0, ((SCREEN_HEIGHT/MAP_COLUMNS)*4), SCREEN_WIDTH/2, (SCREEN_HEIGHT/MAP_COLUMNS)*4);
+
+    // Render difficulty:
+    if (snek->difficulty == EASY) {
+        snek_render_text("Difficulty: Easy", 0, ((SCREEN_HEIGHT/MAP_COLUMNS)*4*2), SCREEN_WIDTH/2, (SCREEN_HEIGHT/MAP_COLUMNS)*4);
+    }
+
+    if (snek->difficulty == REGULAR) {
+        snek_render_text("Difficulty: Regular", 0, ((SCREEN_HEIGHT/MAP_COLUMNS)*4*2), SCREEN_WIDTH/2, (SCREEN_HEIGHT/MAP_COLUMNS)*4);
+    }
+
+    if (snek->difficulty == HARD) {
+        snek_render_text("Difficulty: Hard", 0, ((SCREEN_HEIGHT/MAP_COLUMNS)*4*2), SCREEN_WIDTH/2, (SCREEN_HEIGHT/MAP_COLUMNS)*4);
+    }
+
+    return true;
+}
+
+// Compose the pause overlay onto the current render target.
+// The overlay is translucent, so the paused game shows through it.
+// Return true on success, and false on failure.
+bool snek_compose_pause() {
+    // Return false if the snek global variable pointer does not point to a valid memory location on heap.
+    if (snek == NULL) {
+        printf("snek_compose_pause(): Snek global variable pointer is NULL. Returning false.\n");
+        return false;
+    }
+
+    // Darken everything.
+    // When composing into the cached texture, write the alpha straight into it, otherwise blend over the game drawn underneath.
+    SDL_SetRenderDrawColor(snek->renderer, 0, 0, 0, 160);
+    if (snek->screens[SCREEN_PAUSE] != NULL) {
+        SDL_SetRenderDrawBlendMode(snek->renderer, SDL_BLENDMODE_NONE);
+        SDL_RenderClear(snek->renderer);
+    } else {
+        SDL_SetRenderDrawBlendMode(snek->renderer, SDL_BLENDMODE_BLEND);
+        SDL_RenderFillRect(snek->renderer, NULL);
+    }
+
+    snek_render_text("Paused", 0, 0, SCREEN_WIDTH/8, (SCREEN_HEIGHT/MAP_COLUMNS)*4);
+    snek_render_text("Press P to resume.", 0, ((SCREEN_HEIGHT/MAP_COLUMNS)*4), SCREEN_WIDTH/4, (SCREEN_HEIGHT/MAP_COLUMNS)*4);
+
+    return true;
+}
+
+// Compose a screen onto the current render target.
+bool snek_compose_screen(int32_t screen) {
+    switch (screen) {
+        case SCREEN_MENU:
+            return snek_compose_menu();
+
+        case SCREEN_GAME_OVER:
+            return snek_compose_game_over();
+
+        case SCREEN_PAUSE:
+            return snek_compose_pause();
+    }
+    return false;
+}
+
+// Mark a screen as needing to be composed again, because something on it has changed.
+void snek_screen_invalidate(int32_t screen) {
+    snek->screen_dirty[screen] = true;
+    if (snek->screen_shown == screen) {
+        snek->screen_shown = SCREEN_NONE;
+    }
+}
+
+// Handle events that mean the display or cached screens have lost their contents.
+// If the renderer was reset, the cached textures are gone entirely and must be created again.
+void snek_screen_event() {
+    if (snek->event.type != SDL_WINDOWEVENT && snek->event.type != SDL_RENDER_TARGETS_RESET && snek->event.type != SDL_RENDER_DEVICE_RESET) {
+        return;
+    }
+
+    // Only window events that can lose the window's contents matter, not focus or the mouse entering and leaving.
+    if (snek->event.type == SDL_WINDOWEVENT && snek->event.window.event != SDL_WINDOWEVENT_EXPOSED && snek->event.window.event != SDL_WINDOWEVENT_RESIZED &&
+        snek->event.window.event != SDL_WINDOWEVENT_SIZE_CHANGED && snek->event.window.event != SDL_WINDOWEVENT_RESTORED) {
+        return;
+    }
+
+    for (int32_t i = 0; i < SCREEN_COUNT; i++) {
+        if (snek->event.type == SDL_RENDER_DEVICE_RESET && snek->screens[i] != NULL) {
+            SDL_DestroyTexture(snek->screens[i]);
+            snek->screens[i] = NULL;
+        }
+        snek->screen_dirty[i] = true;
+    }
+    snek->screen_shown = SCREEN_NONE;
+
+    // The glyph textures are gone too, so render them again.
+    if (snek->event.type == SDL_RENDER_DEVICE_RESET) {
+        snek_glyphs_free();
+    }
+}
+
+// Render a retained screen.
+// Compose it into its cached texture only if it is dirty, and only copy it to the display if it isn't already showing.
+// The pause screen is drawn over the last frame of gameplay.
+// Return true on success, and false on failure.
+bool snek_render_screen(int32_t screen) {
+    // Return false if the snek global variable pointer does not point to a valid memory location on heap.
+    if (snek == NULL) {
+        printf("snek_render_screen(): Snek global variable pointer is NULL. Returning false.\n");
+        return false;
+    }
+
+    // Nothing has changed, so there is nothing to do.
+    if (snek->screen_shown == screen && snek->screen_dirty[screen] == false) {
+        return true;
+    }
+
+    // Create the cached texture the first time the screen is shown.
+    // If the renderer can't render to textures, fall back to drawing the screen directly every time.
+    if (snek->screens[screen] == NULL && snek->screen_targets_failed == false && SDL_RenderTargetSupported(snek->renderer) == SDL_FALSE) {
+        printf("snek_render_screen(): Renderer does not support render targets, drawing screens directly.\n");
+        snek->screen_targets_failed = true;
+    }
+    if (snek->screens[screen] == NULL && snek->screen_targets_failed == false) {
+        snek->screens[screen] = SDL_CreateTexture(snek->renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET, SCREEN_WIDTH, SCREEN_HEIGHT);
+        if (snek->screens[screen] == NULL) {
+            printf("snek_render_screen(): Failed to create screen texture, drawing screens directly. SDL_GetError(): %s.\n", SDL_GetError());
+            snek->screen_targets_failed = true;
+        } else {
+            SDL_SetTextureBlendMode(snek->screens[screen], screen == SCREEN_PAUSE ? SDL_BLENDMODE_BLEND : SDL_BLENDMODE_NONE);
+            snek->screen_dirty[screen] = true;
+        }
+    }
+
+    if (screen == SCREEN_PAUSE) {
+        snek_render_game(snek->interpolation);
+    }
+
+    if (snek->screens[screen] == NULL) {
+        snek_compose_screen(screen);
+        SDL_SetRenderDrawBlendMode(snek->renderer, SDL_BLENDMODE_NONE);
+        snek_render_present();
+        return true;
+    }
+
+    // Compose the screen into its cached texture if it has changed.
+    if (snek->screen_dirty[screen] == true) {
+        SDL_SetRenderTarget(snek->renderer, snek->screens[screen]);
+        snek_compose_screen(screen);
+        SDL_SetRenderDrawBlendMode(snek->renderer, SDL_BLENDMODE_NONE);
+        SDL_SetRenderTarget(snek->renderer, NULL);
+        snek->screen_dirty[screen] = false;
+    }
+
+    // Copy the cached screen to the display.
+    SDL_RenderCopy(snek->renderer, snek->screens[screen], NULL, NULL);
+    snek_render_present();
+    snek->screen_shown = screen;
+    return true;
+}
+
+// Render the main menu.
+// Return true on success, and false on failure.
+bool snek_render_menu() {
+    return snek_render_screen(SCREEN_MENU);
+}
+
+// Render the game over screen.
+// Return true on success, and false on failure.
+bool snek_render_game_over() {
+    return snek_render_screen(SCREEN_GAME_OVER);
+}
+
+// Render the pause screen over the paused game.
+// Return true on success, and false on failure.
+bool snek_render_pause() {
+    return snek_render_screen(SCREEN_PAUSE);
+}
+
+// Update the world and entities.
+// Update entities first, then represent them correctly on the tile map.
+// Return true on success, and false on failure.
+bool snek_update() {
+    // Return false if the snek global variable pointer does not point to a valid memory location on heap.
+    if (snek == NULL) {
+        printf("snek_update(): Snek global variable pointer is NULL. Returning false.\n");
+        return false;
+    }
+
+    if (snek->head == NULL) {
+        printf("snek_update(): Snek entity is NULL/invalid. Returning false.\n");
         return false;
     }
 
     // Reset the map:
+    snek_map_clear();
+
+    // Swap the direction in the hash if it has changed since the last update.
+    snek->zobrist ^= snek_zobrist.direction[snek->zobrist_direction] ^ snek_zobrist.direction[snek->direction];
+    snek->zobrist_direction = snek->direction;
+
+    // Store where the head was before updating, to interpolate rendering from.
+    snek->previous_head_row = snek->head->row;
+    snek->previous_head_column = snek->head->column;
+
+    // Create a new snek entity that will contain the updated data
+    struct snek_entity* new_snek_entity = NULL;
+
+    // Update the snek's head position based on what direction it is set to go.
+    int32_t row = snek->head->row;
+    int32_t column = snek->head->column;
+    switch (snek->direction) {
+        case UP: row--; break;
+        case DOWN: row++; break;
+        case LEFT: column--; break;
+        case RIGHT: column++; break;
+    }
+
+    // If it runs into one of the level's walls, return false and exit from the function
+    if (snek_level_is_wall(row, column) == true) {
+        return false;
+    }
+    new_snek_entity = snek_entity_new(row, column);
+
+    // If there was a failure to return a pointer to a new snek entity head, return false.
+    if (new_snek_entity == NULL) {
+        printf("snek_update(): Failed to create a new snek entity for the updated snek entity. Returning false.\n");
+        return false;
+    }
+
+    // Check to see if the snek entity consumed a food entity that round.
+    // If so, set a flag that indicates it did and find a new location to spawn the food.
+    bool food_consumed = false;
+    if (new_snek_entity->row == snek->food_row && new_snek_entity->column == snek->food_column) {
+        food_consumed = true;
+    }
+
+    // Copy the nodes from the snek entity that existed prior to updating position to the new snek entity
+    // Leave out the tail node unless food has been consumed.
+    // Since the head has already been updated, that means that copying the rest of the nodes from the old one will put them in the correct positions for the new snek entity, and copying the last node from the old snek entity will have the effect of growing the new snek in the right place.
+    
+    // Also keep track of where the tail was and where it ends up, to interpolate rendering.
+    struct snek_entity* temp = snek->head;
+    snek->tail_row = new_snek_entity->row;
+    snek->tail_column = new_snek_entity->column;
+    while (temp != NULL) {
+        if (temp->next == NULL) {
+            snek->previous_tail_row = temp->row;
+            snek->previous_tail_column = temp->column;
+        }
+
+        // Tail node check. Exit the loop if food has not been consumed and it is on the tail node.
+        if (temp->next == NULL && food_consumed == false) {
+            break;
+        }
+
+        // Append the old snek node to the new snek entity. Return from function on failure.
+        if (snek_entity_append(new_snek_entity, temp->row, temp->column) == false) {
+            printf("snek_update(): Failed to append new node to the new snek. Returning false.\n");
+            snek_entity_free(new_snek_entity);
+            return false;
+        }
+        snek->tail_row = temp->row;
+        snek->tail_column = temp->column;
+
+        // Traverse through the entity.
+        temp = temp->next;
+    }
+
+    // If copying values to new snek entity occurs successfully, free old snek entity and set the snek entity pointer to the new updated one.
+    snek_entity_free(snek->head);
+    snek->head = new_snek_entity;
+
+    // Update the hash for the head moving, and the tail moving unless food was consumed.
+    snek->zobrist ^= snek_zobrist.head[snek->previous_head_row][snek->previous_head_column];
+    snek->zobrist ^= snek_zobrist.head[snek->head->row][snek->head->column] ^ snek_zobrist.cell[snek->head->row][snek->head->column];
+    if (food_consumed == false) {
+        snek->zobrist ^= snek_zobrist.cell[snek->previous_tail_row][snek->previous_tail_column];
+    }
+
+    // Check for snek entity head to body node collisions. If there are any nodes equal to the head, return false.
+    // Traverse the new snek entity to find this out.
+    // There is no error to be reported since this is not abnormal behaviour, it is an expected feature, a snek entity should not be allowed to eat itself. Hence the lack of printf().
+    temp = snek->head;
+    while (temp != NULL) {
+        if (temp->row == snek->head->row && temp->column == snek->head->column && temp != snek->head) {
+            return false;
+        }
+        temp = temp->next;
+    }
+
+    // Find a new food location that exists outside the snek entity:
+    // This is only if the food is consumed.
+    // Add a point to the score.
+    if (food_consumed == 1) {
+        if (snek_food_entity_spawn() == false) {
+            printf("snek_update(): snek_food_entity_spawn returned false when attempting to find new food location to spawn. Return false.\n");
+            return false;
+        }
+        snek->zobrist ^= snek_zobrist.food[snek->head->row][snek->head->column] ^ snek_zobrist.food[snek->food_row][snek->food_column];
+        snek->score++;
+    }
+
+    // Copy the snek and food entities to the tile map:
+    temp = snek->head;
+    while (temp != NULL) {
+        snek->map[temp->row][temp->column] = GREEN;
+        temp = temp->next;
+    }
+    snek->map[snek->head->row][snek->head->column] = HEAD;
+    snek->map[snek->food_row][snek->food_column] = RED;
+
+    // Return true since all went well.
+    return true;
+}
+
+// Reset the snek entity, food and score to how they are at the start of a game.
+// Return true on success, and false on failure.
+bool snek_game_reset() {
+    // Return false if the snek global variable pointer does not point to a valid memory location on heap.
+    if (snek == NULL) {
+        printf("snek_game_reset(): Snek global variable pointer is NULL. Returning false.\n");
+        return false;
+    }
+
+    if (snek->head != NULL) {
+        snek_entity_free(snek->head);
+    }
+
+    // Spawn the snek entity in the middle of the map, then spawn food away from it.
+    snek->head = snek_entity_new(snek_level.header->spawn_row, snek_level.header->spawn_column);
+    if (snek->head == NULL) {
+        printf("snek_game_reset(): snek_entity_new() failed to create snek entity. Returning false.\n");
+        return false;
+    }
+    snek_food_entity_spawn();
     snek_map_init();
+    snek->score = 1;
+    snek_zobrist_reset();
+
+    // Return true on success.
+    return true;
+}
+
+// Return a hash of the state of the game, covering the snek entity from head to tail, direction, food and score.
+// Two games with the same hash are in the same state.
+uint64_t snek_hash() {
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    struct snek_entity* temp = snek->head;
+    while (temp != NULL) {
+        hash = snek_hash_mix(hash, temp->row);
+        hash = snek_hash_mix(hash, temp->column);
+        temp = temp->next;
+    }
+    hash = snek_hash_mix(hash, snek->direction);
+    hash = snek_hash_mix(hash, snek->food_row);
+    hash = snek_hash_mix(hash, snek->food_column);
+    hash = snek_hash_mix(hash, snek->score);
+    return hash;
+}
+
+// Update the snek entity's direction based on input:
+// Return true on success, and false on failure.
+bool snek_input() {
+    // Return false if the snek global variable pointer does not point to a valid memory location on heap.
+    if (snek == NULL) {
+        printf("snek_input(): Snek global variable pointer is NULL. Returning false.\n");
+        return false;
+    }
+
+    // Store the direction before the keypress, to find out if the keypress changed it.
+    int32_t previous_direction = snek->direction;
+
+    // Set the direction based on recieved keypress
+    switch (snek->event.key.keysym.sym) {
+        case SDLK_w:
+            if (snek->direction != DOWN || snek->status == START_MENU) {
+                snek->direction = UP;
+            }
+            break;
+        
+        case SDLK_UP:
+            if (snek->direction != DOWN || snek->status == START_MENU) {
+                snek->direction = UP;
+            }
+            break;
+
+        case SDLK_s:
+            if (snek->direction != UP || snek->status == START_MENU) {
+                snek->direction = DOWN;
+            }
+            break;
+
+        case SDLK_DOWN:
+            if (snek->direction != UP || snek->status == START_MENU) {
+                snek->direction = DOWN;
+            }
+            break;
+
+        case SDLK_d:
+            if (snek->direction != LEFT || snek->status == START_MENU) {
+                snek->direction = RIGHT;
+            }
+            break;
+        
+        case SDLK_RIGHT:
+            if (snek->direction != LEFT || snek->status == START_MENU) {
+                snek->direction = RIGHT;
+            }
+            break;
+
+        case SDLK_a:
+            if (snek->direction != RIGHT || snek->status == START_MENU) {
+                snek->direction = LEFT;
+            }
+            break;
+        
+        case SDLK_LEFT:
+            if (snek->direction != RIGHT || snek->status == START_MENU) {
+                snek->direction = LEFT;
+            }
+            break;
+    }
+
+    // Record when the keypress that changed direction mid game happened, so the latency until it is displayed can be measured.
+    if (snek->status == MID_GAME && snek->direction != previous_direction) {
+        snek_latency_input(&snek->latency, snek->event.key.timestamp);
+    }
+
+    // Return true on success.
+    return true;
+}
+
+// Latch input right before an update.
+// Process every pending event at once instead of one per loop pass, so the update uses the most recent input.
+// Return true on success, and false on failure.
+bool snek_input_latch() {
+    // Return false if the snek global variable pointer does not point to a valid memory location on heap.
+    if (snek == NULL) {
+        printf("snek_input_latch(): Snek global variable pointer is NULL. Returning false.\n");
+        return false;
+    }
+
+    while (SDL_PollEvent(&snek->event) != 0) {
+        if (snek->event.type == SDL_QUIT) {
+            snek->status = QUIT_LOOP;
+            return true;
+        }
+
+        snek_screen_event();
+
+        if (snek->event.type == SDL_KEYDOWN) {
+            if (snek->event.key.keysym.sym == SDLK_p) {
+                snek->status = PAUSE;
+                return true;
+            }
+            snek_input();
+        }
+    }
+
+    // Return true on success.
+    return true;
+}
+
+// Start the autopilot planning the next update from the current state of the game.
+// The planner is created the first time the autopilot is used, and the autopilot is turned off if that fails.
+void snek_autopilot_start() {
+    if (snek->planner == NULL) {
+        snek->planner = snek_planner_new(snek->random_state);
+        if (snek->planner == NULL) {
+            printf("snek_autopilot_start(): Failed to create planner. Turning autopilot off.\n");
+            snek->autopilot = false;
+            return;
+        }
+    }
+
+    struct snek_engine engine;
+    snek_engine_from_snek(&engine);
+    snek_planner_start(snek->planner, &engine, snek_planner_budget(snek->difficulty));
+}
+
+// Reset the timer, so no time is owed to updates as of now.
+void snek_timer_reset() {
+    snek->last_time = SDL_GetPerformanceCounter();
+    snek->current_time = snek->last_time;
+    snek->accumulator = 0;
+}
+
+// Print how far the measured tick rate of the game deviated from the rate set by the difficulty.
+void snek_tick_rate_print() {
+    double nominal_rate = 1000.0 / snek->difficulty;
+    double game_seconds = (double)snek->game_time / (double)SDL_GetPerformanceFrequency();
+    if (game_seconds <= 0) {
+        return;
+    }
+
+    double measured_rate = snek->ticks / game_seconds;
+    printf("Tick rate: %.2f ticks/s measured, %.2f ticks/s nominal (%+.2f%%), %llu ticks dropped while catching up.\n",
+        measured_rate, nominal_rate, (measured_rate - nominal_rate) / nominal_rate * 100.0, (unsigned long long)snek->ticks_dropped);
+}
+
+// Run the main program loop.
+// Return true on time to quit, false to continue
+void snek_loop() {
+    // Return false if the snek global variable pointer does not point to a valid memory location on heap.
+    if (snek == NULL) {
+        printf("snek_loop(): Snek global variable pointer is NULL. Quitting.\n");
+        return;
+    }
+
+    // Save some CPU time by pausing for a little.
+    SDL_Delay(2);
+
+    // Run the loop program procedure for before the game starts.
+    // Start the game once the user is ready.
+    // Scan for input until the user signals they're able to play, then update the state.
+    if (snek->status == START_MENU) {
+        // Count allocations towards the status they are made in.
+        snek_allocation_status(START_MENU);
+
+        // Render to the screen:
+        snek_render_menu();
+
+        // Poll for input.
+        while (SDL_PollEvent(&snek->event) != 0) {
+            if (snek->event.type == SDL_QUIT) {
+                snek->status = QUIT_LOOP;
+                return;
+            }
+
+            snek_screen_event();
+
+            if (snek->event.type == SDL_KEYDOWN) {
+                // Update snek direction and proceed to game.
+                snek_input();
+                snek->status = MID_GAME;
+
+                // If a difficulty option key is pressed, update difficulty and don't progress to game
+                // Scan again for more inputs
+                switch (snek->event.key.keysym.sym) {
+                    case SDLK_e:
+                        snek->difficulty = EASY;
+                        snek->status = START_MENU;
+                        break;
+
+                    case SDLK_r:
+                        snek->difficulty = REGULAR;
+                        snek->status = START_MENU;
+                        break;
+
+                    case SDLK_q:
+                        snek->difficulty = HARD;
+                        snek->status = START_MENU;
+                        break;
+
+                    case SDLK_l:
+                        snek->late_latch = !snek->late_latch;
+                        snek->status = START_MENU;
+                        break;
+
+                    case SDLK_o:
+                        snek->autopilot = !snek->autopilot;
+                        snek->status = START_MENU;
+                        break;
+                }
+
+                // A setting on the menu changed, so it needs composing again.
+                if (snek->status == START_MENU) {
+                    snek_screen_invalidate(SCREEN_MENU);
+                }
+
+                // Start measuring input latency and tick rate from scratch for the new game.
+                if (snek->status == MID_GAME) {
+                    snek_latency_reset(&snek->latency);
+                    snek_timer_reset();
+                    snek->game_time = 0;
+                    snek->ticks = 0;
+                    snek->ticks_dropped = 0;
+
+                    // Start planning the first update if the autopilot is on.
+                    if (snek->autopilot == true) {
+                        snek_autopilot_start();
+                    }
+
+                    // Show bots the board the game starts from.
+                    snek_channel_publish();
+                    if (snek->plugin != NULL) {
+                        snek_plugin_start_game();
+                    }
+                }
+            }
+            break;
+        }
+    }
+
+    // Run the loop program procedure for the main gameplay:
+    if (snek->status == MID_GAME) {
+        //printf("I'm in the mid game\n");
+        snek_allocation_status(MID_GAME);
+
+        // Poll for input.
+        // With late latching, input is left queued until right before the next update instead.
+        while (snek->late_latch == false && SDL_PollEvent(&snek->event) != 0) {
+            if (snek->event.type == SDL_QUIT) {
+                snek->status = QUIT_LOOP;
+                return;
+            }
+
+            // Forget retained textures the renderer has lost.
+            snek_screen_event();
+
+            if (snek->event.type == SDL_KEYDOWN) {
+                if (snek->event.key.keysym.sym == SDLK_p) {
+                    snek->status = PAUSE;
+                    break;
+                }
+                snek_input();
+            }
+            break;
+        }
+
+        // Stop if the input paused the game.
+        if (snek->status != MID_GAME) {
+            return;
+        }
+
+        // Add the time elapsed since last time this code was run to the accumulator.
+        // Then run exactly as many updates as that time is owed, keeping the remainder for next time.
+        // This means that late updates do not push back every later update, so the tick rate does not drift.
+        // The number the difficulty is set to is actually the milliseconds in delay it takes between updates!
+        snek->current_time = SDL_GetPerformanceCounter();
+        snek->accumulator += snek->current_time - snek->last_time;
+        snek->game_time += snek->current_time - snek->last_time;
+        snek->last_time = snek->current_time;
+
+        uint64_t tick_period = SDL_GetPerformanceFrequency() * snek->difficulty / 1000;
+        int32_t updates = 0;
+        while (snek->accumulator >= tick_period && snek->status == MID_GAME) {
+            // If too many updates are owed, drop the rest of the time owed rather than fast forwarding the game.
+            if (updates == MAX_CATCH_UP_UPDATES) {
+                snek->ticks_dropped += snek->accumulator / tick_period;
+                snek->accumulator = snek->accumulator % tick_period;
+                break;
+            }
+
+            // Sample the latest input right before updating when late latching.
+            // Stop if the input paused or quit the game.
+            if (snek->late_latch == true) {
+                snek_input_latch();
+                if (snek->status != MID_GAME) {
+                    return;
+                }
+            }
+
+            // Take the direction from the autopilot's plan when it is on, or else from a bot on the control channel.
+            if (snek->autopilot == true) {
+                snek->direction = snek_planner_finish(snek->planner, false);
+            } else if (snek->plugin != NULL) {
+                snek->direction = snek_plugin_finish(snek->plugin, snek->direction, false);
+            } else {
+                snek_channel_consume();
+            }
+
+            // Check to make sure the game is still won or not.
+            // If not, set status to game over
+            if (snek_update() == false) {
+                snek->status = GAME_OVER;
+            }
+            snek_latency_tick(&snek->latency, SDL_GetTicks());
+            snek->accumulator -= tick_period;
+            snek->ticks++;
+            updates++;
+
+            // Plan the next update in the background while waiting for it.
+            if (snek->autopilot == true && snek->status == MID_GAME) {
+                snek_autopilot_start();
+            }
+            if (snek->autopilot == false && snek->plugin != NULL && snek->status == MID_GAME) {
+                snek_plugin_start_game();
+            }
+
+            // Publish the updated board to bots.
+            snek_channel_publish();
+        }
+
+        // Render to the screen at the display rate, once the first update has happened.
+        // Draw the moving entities as far towards the next update as the time owed to it.
+        if (snek->ticks > 0) {
+            snek_render((float)snek->accumulator / (float)tick_period);
+        }
+
+        // Report the input latency and tick rate of the game once it is over, including the final update.
+        // The game over screen shows the final score, so it needs composing again.
+        if (snek->status == GAME_OVER) {
+            snek_allocation_status(GAME_OVER);
+            snek_screen_invalidate(SCREEN_GAME_OVER);
+            snek_latency_print(&snek->latency, snek->late_latch);
+            snek_allocation_print();
+            snek_tick_rate_print();
+            if (snek->autopilot == true) {
+                snek_planner_print(snek->planner);
+            } else if (snek->plugin != NULL) {
+                snek_plugin_print(snek->plugin);
+            }
+        }
+    }
+
+    // Run the loop program procedure for the game over screen.
+    if (snek->status == GAME_OVER) {
+        snek_allocation_status(GAME_OVER);
+
+        // Render game over screen.
+        snek_render_game_over();
+
+        // Poll for input
+        while (SDL_PollEvent(&snek->event) != 0) {
+            if (snek->event.type == SDL_QUIT) {
+                snek->status = QUIT_LOOP;
+                return;
+            }
+
+            snek_screen_event();
+
+            // On any key press, reset the game and go back to the start menu.
+            if (snek->event.type == SDL_KEYDOWN) {
+                snek_game_reset();
+                snek->status = START_MENU;
+            }
+            break;
+        }
+    }
+
+    if (snek->status == PAUSE) {
+        snek_allocation_status(PAUSE);
+
+        // Render the pause screen.
+        snek_render_pause();
+
+        // Scan for input and resume when any key is pressed.
+        while (SDL_PollEvent(&snek->event) != 0) {
+            if (snek->event.type == SDL_QUIT) {
+                snek->status = QUIT_LOOP;
+                return;
+            }
+
+            snek_screen_event();
+
+            if (snek->event.type == SDL_KEYDOWN) {
+                if (snek->event.key.keysym.sym == SDLK_p) {
+                    // Time spent paused is not owed to updates.
+                    snek->status = MID_GAME;
+                    snek_timer_reset();
+                    break;
+                }
+            }
+            break;
+        }
+    }
+    return;
+}
+
+// Pack a tile colour label into a pixel for the spectator wall texture.
+uint32_t snek_tile_pixel(int32_t tile) {
+    return 0xFF000000 | ((uint32_t)snek_tile_colours[tile][0] << 16) | ((uint32_t)snek_tile_colours[tile][1] << 8) | snek_tile_colours[tile][2];
+}
+
+// Initialise the spectator wall with the passed in number of boards, in a grid as close to square as possible.
+// Return true on success, and false on failure.
+bool snek_spectator_init(int32_t board_count, uint64_t seed) {
+    struct snek_spectator* spectator = (struct snek_spectator*) calloc(1, sizeof(struct snek_spectator));
+    if (spectator == NULL) {
+        printf("snek_spectator_init(): Failed to allocate memory for spectator wall. Returning false.\n");
+        return false;
+    }
+
+    if (board_count < 1) {
+        board_count = 1;
+    }
+    if (board_count > SPECTATOR_MAX_BOARDS) {
+        board_count = SPECTATOR_MAX_BOARDS;
+    }
+
+    spectator->board_count = board_count;
+    spectator->grid_columns = 1;
+    while (spectator->grid_columns * spectator->grid_columns < board_count) {
+        spectator->grid_columns++;
+    }
+    spectator->grid_rows = (board_count + spectator->grid_columns - 1) / spectator->grid_columns;
+
+    spectator->boards = (struct snek_engine*) malloc(sizeof(struct snek_engine) * board_count);
+    if (spectator->boards == NULL) {
+        printf("snek_spectator_init(): Failed to allocate memory for boards. Returning false.\n");
+        free(spectator);
+        return false;
+    }
+
+    spectator->texture = SDL_CreateTexture(snek->renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING,
+        spectator->grid_columns * MAP_COLUMNS, spectator->grid_rows * MAP_ROWS);
+    if (spectator->texture == NULL) {
+        printf("snek_spectator_init(): Failed to create spectator texture. SDL_GetError(): %s. Returning false.\n", SDL_GetError());
+        free(spectator->boards);
+        free(spectator);
+        return false;
+    }
+
+    // Draw an empty board from the level's tile map.
+    for (int32_t i = 0; i < MAP_ROWS; i++) {
+        for (int32_t j = 0; j < MAP_COLUMNS; j++) {
+            spectator->background[i * MAP_COLUMNS + j] = snek_tile_pixel(snek_level.tiles[i][j]);
+        }
+    }
+
+    spectator->seed = seed;
+    spectator->random_state = snek_random_seed(seed);
+    for (int32_t i = 0; i < board_count; i++) {
+        snek_engine_init(&spectator->boards[i], spectator->seed);
+        spectator->seed++;
+    }
+
+    spectator->report_time = SDL_GetPerformanceCounter();
+    snek->spectator = spectator;
+    snek->status = MID_GAME;
+    snek_timer_reset();
+    return true;
+}
+
+// Free the spectator wall.
+void snek_spectator_free() {
+    if (snek->spectator == NULL) {
+        return;
+    }
+
+    SDL_DestroyTexture(snek->spectator->texture);
+    free(snek->spectator->boards);
+    free(snek->spectator);
+    snek->spectator = NULL;
+}
 
-    // Create a new snek entity that will contain the updated data
-    struct snek_entity* new_snek_entity;
+// Update every board on the spectator wall by one tick, restarting any game that ends.
+void snek_spectator_update() {
+    struct snek_spectator* spectator = snek->spectator;
 
-    // Update the snek's head position based on what direction it is set to go.
-    // If it goes out of bounds, return false and exit from the function
-    switch (snek->direction) {
-        case UP:
-            if (snek->head->row - 1 <= 1) {
-                return false;
+    for (int32_t i = 0; i < spectator->board_count; i++) {
+        struct snek_engine* board = &spectator->boards[i];
+        board->direction = snek_engine_greedy_direction(board, &spectator->random_state);
+        if (snek_engine_update(board) == false) {
+            snek_engine_init(board, spectator->seed);
+            spectator->seed++;
+        }
+    }
+}
+
+// Draw every board into the spectator texture, then copy it to the window in one go.
+// The texture is scaled to fit the window, keeping its aspect ratio.
+void snek_spectator_render() {
+    struct snek_spectator* spectator = snek->spectator;
+    void* pixels = NULL;
+    int32_t pitch = 0;
+
+    if (SDL_LockTexture(spectator->texture, NULL, &pixels, &pitch) == 0) {
+        uint32_t green = snek_tile_pixel(GREEN);
+        uint32_t head = snek_tile_pixel(HEAD);
+        uint32_t red = snek_tile_pixel(RED);
+
+        for (int32_t i = 0; i < spectator->board_count; i++) {
+            struct snek_engine* board = &spectator->boards[i];
+            uint8_t* origin = (uint8_t*)pixels + (i / spectator->grid_columns) * MAP_ROWS * pitch + (i % spectator->grid_columns) * MAP_COLUMNS * sizeof(uint32_t);
+
+            // Copy in the empty board a row at a time, then draw the snek entity from tail to head and the food over it.
+            for (int32_t row = 0; row < MAP_ROWS; row++) {
+                memcpy(origin + row * pitch, &spectator->background[row * MAP_COLUMNS], MAP_COLUMNS * sizeof(uint32_t));
+            }
+            for (int32_t j = board->length - 1; j >= 0; j--) {
+                int32_t index = (board->head_index - j + MAP_ROWS * MAP_COLUMNS) % (MAP_ROWS * MAP_COLUMNS);
+                ((uint32_t*)(origin + board->body_row[index] * pitch))[board->body_column[index]] = j == 0 ? head : green;
             }
-            new_snek_entity = snek_entity_new(snek->head->row - 1, snek->head->column);
+            ((uint32_t*)(origin + board->food_row * pitch))[board->food_column] = red;
+        }
+
+        SDL_UnlockTexture(spectator->texture);
+    }
+
+    // Fit the wall to the window, leaving bars either side if the aspect ratios differ.
+    SDL_Rect wall_rect;
+    int32_t wall_width = spectator->grid_columns * MAP_COLUMNS;
+    int32_t wall_height = spectator->grid_rows * MAP_ROWS;
+    if ((int64_t)SCREEN_WIDTH * wall_height < (int64_t)SCREEN_HEIGHT * wall_width) {
+        wall_rect.w = SCREEN_WIDTH;
+        wall_rect.h = (int32_t)((int64_t)SCREEN_WIDTH * wall_height / wall_width);
+    } else {
+        wall_rect.h = SCREEN_HEIGHT;
+        wall_rect.w = (int32_t)((int64_t)SCREEN_HEIGHT * wall_width / wall_height);
+    }
+    wall_rect.x = (SCREEN_WIDTH - wall_rect.w) / 2;
+    wall_rect.y = (SCREEN_HEIGHT - wall_rect.h) / 2;
+
+    SDL_SetRenderDrawColor(snek->renderer, 0, 0, 0, 0);
+    SDL_RenderClear(snek->renderer);
+    SDL_RenderCopy(snek->renderer, spectator->texture, NULL, &wall_rect);
+    snek_render_present();
+}
+
+// Run the spectator wall loop.
+// Updates run on the same fixed timestep as the game, and every board is drawn once per frame.
+void snek_spectator_loop() {
+    struct snek_spectator* spectator = snek->spectator;
+
+    while (SDL_PollEvent(&snek->event) != 0) {
+        if (snek->event.type == SDL_QUIT || (snek->event.type == SDL_KEYDOWN && snek->event.key.keysym.sym == SDLK_q)) {
+            snek->status = QUIT_LOOP;
+            return;
+        }
+    }
+
+    // Run every update owed, dropping any time owed past the catch up limit.
+    uint64_t start_time = SDL_GetPerformanceCounter();
+    snek->accumulator += start_time - snek->last_time;
+    snek->last_time = start_time;
+
+    uint64_t tick_period = SDL_GetPerformanceFrequency() * snek->difficulty / 1000;
+    int32_t updates = 0;
+    while (snek->accumulator >= tick_period) {
+        if (updates == MAX_CATCH_UP_UPDATES) {
+            snek->accumulator = snek->accumulator % tick_period;
             break;
+        }
+        snek_spectator_update();
+        snek->accumulator -= tick_period;
+        updates++;
+    }
 
-        case DOWN:
-            if (snek->head->row + 1 >= MAP_ROWS - 1) {
-                return false;
+    uint64_t draw_start_time = SDL_GetPerformanceCounter();
+    snek_spectator_render();
+    uint64_t end_time = SDL_GetPerformanceCounter();
+
+    spectator->simulate_time += draw_start_time - start_time;
+    spectator->draw_time += end_time - draw_start_time;
+    spectator->frames++;
+
+    // Report the frame rate and where the time went every five seconds.
+    if (end_time - spectator->report_time > SDL_GetPerformanceFrequency() * 5) {
+        double frequency = (double)SDL_GetPerformanceFrequency();
+        printf("Spectating %d boards: %.1f fps, %.3fms simulating and %.3fms drawing per frame.\n", spectator->board_count,
+            spectator->frames / ((end_time - spectator->report_time) / frequency),
+            spectator->simulate_time * 1000.0 / frequency / spectator->frames,
+            spectator->draw_time * 1000.0 / frequency / spectator->frames);
+        spectator->report_time = end_time;
+        spectator->simulate_time = 0;
+        spectator->draw_time = 0;
+        spectator->frames = 0;
+    }
+
+    // Save some CPU time by pausing for a little.
+    SDL_Delay(1);
+}
+
+// Choose the input for the next tick of a fuzzed game.
+// Mostly no input or heading for the food so games last and the snek entity grows long, with the odd random or reversing turn.
+int32_t snek_fuzz_input(struct snek_engine* engine, uint64_t* state) {
+    int32_t head_row = engine->body_row[engine->head_index];
+    int32_t head_column = engine->body_column[engine->head_index];
+    uint32_t choice = snek_random(state) % 100;
+
+    if (choice < 60) {
+        return FUZZ_NO_INPUT;
+    }
+
+    if (choice < 90) {
+        if (engine->food_row < head_row && engine->direction != DOWN) {
+            return UP;
+        }
+        if (engine->food_row > head_row && engine->direction != UP) {
+            return DOWN;
+        }
+        if (engine->food_column < head_column && engine->direction != RIGHT) {
+            return LEFT;
+        }
+        if (engine->food_column > head_column && engine->direction != LEFT) {
+            return RIGHT;
+        }
+        return FUZZ_NO_INPUT;
+    }
+
+    // Turn randomly, never reversing unless this is one of the rare raw inputs.
+    int32_t direction = snek_random(state) % 4;
+    if (choice < 98 && direction == (engine->direction ^ 1)) {
+        return FUZZ_NO_INPUT;
+    }
+    return direction;
+}
+
+// Run a game from the passed in seed on both snek_update() and the headless engine in lockstep, comparing state hashes every tick.
+// When generating, inputs are chosen by snek_fuzz_input() and stored. Otherwise the passed in inputs are replayed, followed by no input.
+// When verbose, print the state of both games every tick.
+// Return the tick the games diverged at, or -1 if they never did.
+int32_t snek_fuzz_game(struct snek_engine* engine, uint64_t seed, uint8_t* inputs, int32_t* input_count, bool generate, bool verbose, uint64_t* ticks, struct snek_transposition_table* transpositions) {
+    uint64_t input_state = snek_random_seed(~seed);
+
+    // Start both games from the same seed.
+    snek->random_state = snek_random_seed(seed);
+    snek->direction = UP;
+    snek_game_reset();
+    snek_engine_init(engine, seed);
+
+    if (snek_hash() != snek_engine_hash(engine) || snek->zobrist != engine->zobrist) {
+        return 0;
+    }
+
+    for (int32_t tick = 0; tick < FUZZ_MAX_TICKS; tick++) {
+        // Apply the same input to both games.
+        int32_t input = FUZZ_NO_INPUT;
+        if (generate == true) {
+            input = snek_fuzz_input(engine, &input_state);
+            inputs[tick] = input;
+            *input_count = tick + 1;
+        } else if (tick < *input_count) {
+            input = inputs[tick];
+        }
+
+        if (input != FUZZ_NO_INPUT) {
+            snek->direction = input;
+            engine->direction = input;
+        }
+
+        bool reference_result = snek_update();
+        bool engine_result = snek_engine_update(engine);
+        (*ticks)++;
+
+        uint64_t reference_hash = snek_hash();
+        uint64_t engine_hash = snek_engine_hash(engine);
+        if (verbose == true) {
+            printf("Tick %d: input %d reference %d %016llx zobrist %016llx head %d,%d food %d,%d score %d | engine %d %016llx zobrist %016llx head %d,%d food %d,%d score %d\n",
+                tick, input, reference_result, (unsigned long long)reference_hash, (unsigned long long)snek->zobrist, snek->head->row, snek->head->column, snek->food_row, snek->food_column, snek->score,
+                engine_result, (unsigned long long)engine_hash, (unsigned long long)engine->zobrist, engine->body_row[engine->head_index], engine->body_column[engine->head_index], engine->food_row, engine->food_column, engine->score);
+        }
+
+        // The games diverge if one ends before the other, or their states differ.
+        // The incrementally updated Zobrist hashes must also match each other and the hash worked out from scratch.
+        if (reference_result != engine_result || reference_hash != engine_hash) {
+            return tick;
+        }
+        if (snek->zobrist != engine->zobrist || engine->zobrist != snek_engine_zobrist(engine)) {
+            return tick;
+        }
+
+        // Report positions the game has already been in, by the tick they were first seen.
+        uint64_t first_tick = 0;
+        if (transpositions != NULL && reference_result == true) {
+            if (snek_transposition_probe(transpositions, snek->zobrist, &first_tick) == true) {
+                printf("Tick %d: position repeats tick %llu.\n", tick, (unsigned long long)first_tick);
+            } else {
+                snek_transposition_store(transpositions, snek->zobrist, tick);
             }
-            new_snek_entity = snek_entity_new(snek->head->row + 1, snek->head->column);
-            break;
+        }
 
-        case LEFT:
-            if (snek->head->column - 1 < 1) {
-                return false;
+        if (reference_result == false) {
+            return -1;
+        }
+    }
+
+    return -1;
+}
+
+// Shrink the inputs of a diverging game to a minimal replay that still diverges.
+// Remove chunks of inputs while it still diverges, halving the chunk size each pass, then drop inputs one at a time.
+// Return the number of inputs left.
+int32_t snek_fuzz_shrink(struct snek_engine* engine, uint64_t seed, uint8_t* inputs, int32_t input_count) {
+    uint8_t* candidate = (uint8_t*) malloc(FUZZ_MAX_TICKS);
+    if (candidate == NULL) {
+        printf("snek_fuzz_shrink(): Failed to allocate memory for candidate inputs. Returning inputs unshrunk.\n");
+        return input_count;
+    }
+    uint64_t ticks = 0;
+
+    for (int32_t chunk = input_count / 2; chunk >= 1; chunk /= 2) {
+        int32_t i = 0;
+        while (i < input_count) {
+            // Copy every input except the chunk.
+            int32_t candidate_count = 0;
+            for (int32_t j = 0; j < input_count; j++) {
+                if (j < i || j >= i + chunk) {
+                    candidate[candidate_count] = inputs[j];
+                    candidate_count++;
+                }
+            }
+
+            // Keep the candidate if it still diverges, only up to the tick it diverges at.
+            int32_t divergence = snek_fuzz_game(engine, seed, candidate, &candidate_count, false, false, &ticks, NULL);
+            if (divergence >= 0) {
+                input_count = divergence + 1 < candidate_count ? divergence + 1 : candidate_count;
+                memcpy(inputs, candidate, input_count);
+            } else {
+                i += chunk;
             }
-            new_snek_entity = snek_entity_new(snek->head->row, snek->head->column - 1);
+        }
+    }
+
+    // Replace each remaining input with no input if it still diverges.
+    for (int32_t i = 0; i < input_count; i++) {
+        if (inputs[i] == FUZZ_NO_INPUT) {
+            continue;
+        }
+        uint8_t input = inputs[i];
+        inputs[i] = FUZZ_NO_INPUT;
+        if (snek_fuzz_game(engine, seed, inputs, &input_count, false, false, &ticks, NULL) < 0) {
+            inputs[i] = input;
+        }
+    }
+
+    free(candidate);
+    return input_count;
+}
+
+// Print a replay of a game as a command line that reruns it.
+// Inputs are written as U, D, L and R for each direction, and . for no input.
+void snek_fuzz_print_replay(uint64_t seed, uint8_t* inputs, int32_t input_count) {
+    printf("Replay: ./snek --replay %llu ", (unsigned long long)seed);
+    for (int32_t i = 0; i < input_count; i++) {
+        putchar(inputs[i] < FUZZ_NO_INPUT ? "UDLR"[inputs[i]] : '.');
+    }
+    printf("\n");
+}
+
+// Fuzz snek_update() against the headless engine for at least the passed in number of ticks, one game per seed counting up from the passed in seed.
+// On divergence, shrink it and print a minimal replay.
+// Return true if no game diverged, and false otherwise.
+bool snek_fuzz(uint64_t target_ticks, uint64_t seed) {
+    struct snek_engine* engine = (struct snek_engine*) malloc(sizeof(struct snek_engine));
+    uint8_t* inputs = (uint8_t*) malloc(FUZZ_MAX_TICKS);
+    if (engine == NULL || inputs == NULL || snek_headless_init() == false) {
+        printf("snek_fuzz(): Failed to allocate memory for fuzzing. Returning false.\n");
+        free(engine);
+        free(inputs);
+        return false;
+    }
+
+    uint64_t ticks = 0;
+    uint64_t games = 0;
+    uint64_t start_time = SDL_GetPerformanceCounter();
+    uint64_t report_time = start_time;
+    bool result = true;
+
+    while (ticks < target_ticks) {
+        int32_t input_count = 0;
+        int32_t divergence = snek_fuzz_game(engine, seed + games, inputs, &input_count, true, false, &ticks, NULL);
+        if (divergence >= 0) {
+            printf("snek_fuzz(): Game with seed %llu diverged at tick %d. Shrinking.\n", (unsigned long long)(seed + games), divergence);
+            input_count = snek_fuzz_shrink(engine, seed + games, inputs, divergence + 1);
+            snek_fuzz_print_replay(seed + games, inputs, input_count);
+            result = false;
             break;
+        }
+        games++;
+
+        // Report progress every ten seconds.
+        uint64_t current_time = SDL_GetPerformanceCounter();
+        if (current_time - report_time > SDL_GetPerformanceFrequency() * 10) {
+            printf("Fuzzed %llu ticks over %llu games.\n", (unsigned long long)ticks, (unsigned long long)games);
+            report_time = current_time;
+        }
+    }
+
+    double seconds = (double)(SDL_GetPerformanceCounter() - start_time) / (double)SDL_GetPerformanceFrequency();
+    printf("Fuzzed %llu ticks over %llu games in %.2f seconds (%.0f ticks/s).\n", (unsigned long long)ticks, (unsigned long long)games, seconds, ticks / seconds);
+
+    snek_headless_quit();
+    free(engine);
+    free(inputs);
+    return result;
+}
+
+// Replay a game from a seed and a string of inputs, printing the state of both games every tick.
+// Return true if the games did not diverge, and false otherwise.
+bool snek_replay(uint64_t seed, char* replay) {
+    struct snek_engine* engine = (struct snek_engine*) malloc(sizeof(struct snek_engine));
+    uint8_t* inputs = (uint8_t*) malloc(FUZZ_MAX_TICKS);
+    if (engine == NULL || inputs == NULL || snek_headless_init() == false) {
+        printf("snek_replay(): Failed to allocate memory for replaying. Returning false.\n");
+        free(engine);
+        free(inputs);
+        return false;
+    }
+
+    int32_t input_count = 0;
+    for (; replay[input_count] != '\0' && input_count < FUZZ_MAX_TICKS; input_count++) {
+        switch (replay[input_count]) {
+            case 'U': inputs[input_count] = UP; break;
+            case 'D': inputs[input_count] = DOWN; break;
+            case 'L': inputs[input_count] = LEFT; break;
+            case 'R': inputs[input_count] = RIGHT; break;
+            default: inputs[input_count] = FUZZ_NO_INPUT; break;
+        }
+    }
+
+    // Positions seen so far, to report when the replay goes back to one.
+    struct snek_transposition_table* transpositions = snek_transposition_new(TRANSPOSITION_TABLE_BITS);
+
+    uint64_t ticks = 0;
+    int32_t divergence = snek_fuzz_game(engine, seed, inputs, &input_count, false, true, &ticks, transpositions);
+    if (divergence >= 0) {
+        printf("Games diverged at tick %d.\n", divergence);
+    } else {
+        printf("Games did not diverge.\n");
+    }
+
+    snek_transposition_free(transpositions);
+    snek_headless_quit();
+    free(engine);
+    free(inputs);
+    return divergence < 0;
+}
+
+// Play games headless on snek_update() for at least the passed in number of ticks, one game per seed counting up from the passed in seed, counting allocations as it goes.
+// Games alternate between fuzzed inputs and the cheap bot used for spectating, which grows the snek entity far longer.
+// Games are reset in the game over status, and every tick is run in the mid game status.
+// Then the snek entity pool is filled as far as snek_update() ever fills it, with the old and new snek entity both as long as the level allows.
+// Only the update is tested. Rendering needs a window and a font, so its allocations are only counted while playing.
+// Return true if no allocation was made and the pool never ran out during any tick, and false otherwise.
+bool snek_allocation_test(uint64_t target_ticks, uint64_t seed) {
+    #ifndef SNEK_ALLOCATION_COUNTING
+        printf("snek_allocation_test(): Allocation counting needs glibc. Returning false.\n");
+        return false;
+    #endif
+
+    struct snek_engine* engine = (struct snek_engine*) malloc(sizeof(struct snek_engine));
+    if (engine == NULL || snek_headless_init() == false) {
+        printf("snek_allocation_test(): Failed to allocate memory for testing. Returning false.\n");
+        free(engine);
+        return false;
+    }
+
+    // Forget allocations made before the first game.
+    for (int32_t i = 0; i < STATUS_COUNT; i++) {
+        atomic_store(&snek_allocations.count[i], 0);
+    }
+
+    uint64_t ticks = 0;
+    uint64_t games = 0;
+    int32_t longest = 0;
+    uint64_t fallbacks = 0;
+    while (ticks < target_ticks) {
+        // Start a game, choosing inputs by following along on the headless engine.
+        snek_allocation_status(GAME_OVER);
+        bool greedy = games % 2 == 1;
+        uint64_t input_state = snek_random_seed(~(seed + games));
+        snek->random_state = snek_random_seed(seed + games);
+        snek->direction = UP;
+        snek_game_reset();
+        snek_engine_init(engine, seed + games);
+
+        snek_allocation_status(MID_GAME);
+        uint64_t game_fallbacks = snek_entity_pool.fallbacks;
+        for (int32_t tick = 0; tick < FUZZ_MAX_TICKS; tick++) {
+            int32_t input = greedy == true ? snek_engine_greedy_direction(engine, &input_state) : snek_fuzz_input(engine, &input_state);
+            if (input != FUZZ_NO_INPUT) {
+                snek->direction = input;
+                engine->direction = input;
+            }
+
+            bool result = snek_update();
+            snek_engine_update(engine);
+            ticks++;
+            if (result == false) {
+                break;
+            }
+            if (engine->length > longest) {
+                longest = engine->length;
+            }
+        }
+        fallbacks += snek_entity_pool.fallbacks - game_fallbacks;
+        games++;
+    }
+
+    // Hold an old and a new snek entity at once, the old one on every free tile and the new one a node longer, as snek_update() would if it could.
+    snek_allocation_status(GAME_OVER);
+    snek_entity_free(snek->head);
+    snek->head = NULL;
+    snek_allocation_status(MID_GAME);
+    uint64_t peak_fallbacks = snek_entity_pool.fallbacks;
+    struct snek_entity* entities[2] = {NULL, NULL};
+    for (int32_t i = 0; i < 2; i++) {
+        for (uint32_t j = 0; j < snek_level.header->free_count + i; j++) {
+            struct snek_entity* node = snek_entity_new(0, 0);
+            if (node == NULL) {
+                break;
+            }
+            node->next = entities[i];
+            entities[i] = node;
+        }
+    }
+    fallbacks += snek_entity_pool.fallbacks - peak_fallbacks;
+    snek_allocation_status(GAME_OVER);
+    for (int32_t i = 0; i < 2; i++) {
+        if (entities[i] != NULL) {
+            snek_entity_free(entities[i]);
+        }
+    }
+
+    uint64_t mid_game = atomic_load(&snek_allocations.count[MID_GAME]);
+    printf("Played %llu ticks over %llu games, with a longest snek entity of %d nodes, then held two snek entities of %u nodes.\n",
+        (unsigned long long)ticks, (unsigned long long)games, longest, snek_level.header->free_count);
+    printf("Only snek_update() was tested, as rendering needs a window.\n");
+    snek_allocation_print();
+    if (mid_game > 0) {
+        printf("snek_allocation_test(): %llu allocations were made mid game. Returning false.\n", (unsigned long long)mid_game);
+    }
+    if (fallbacks > 0) {
+        printf("snek_allocation_test(): The snek entity pool ran out %llu times mid game. Returning false.\n", (unsigned long long)fallbacks);
+    }
+
+    snek_headless_quit();
+    free(engine);
+    return mid_game == 0 && fallbacks == 0;
+}
+
+// Evaluate the autopilot by playing headless games with it, planning each update within the budget of the passed in difficulty.
+// Print the score of each game and the rollouts per second per core.
+// Return true on success, and false on failure.
+bool snek_autopilot_evaluate(int32_t games, uint64_t seed, int32_t difficulty) {
+    struct snek_engine* engine = (struct snek_engine*) malloc(sizeof(struct snek_engine));
+    struct snek_planner* planner = snek_planner_new(seed);
+    if (engine == NULL || planner == NULL) {
+        printf("snek_autopilot_evaluate(): Failed to create headless game or planner. Returning false.\n");
+        free(engine);
+        snek_planner_free(planner);
+        return false;
+    }
+
+    int64_t total_score = 0;
+    for (int32_t game = 0; game < games; game++) {
+        snek_engine_init(engine, seed + game);
+
+        int32_t ticks = 0;
+        while (engine->status == MID_GAME && ticks < FUZZ_MAX_TICKS) {
+            snek_planner_start(planner, engine, snek_planner_budget(difficulty));
+            engine->direction = snek_planner_finish(planner, true);
+            snek_engine_update(engine);
+            ticks++;
+        }
+
+        printf("Game %d: score %d after %d ticks.\n", game, engine->score, ticks);
+        total_score += engine->score;
+    }
+
+    printf("Mean score over %d games: %.2f\n", games, games > 0 ? (double)total_score / games : 0.0);
+    snek_planner_print(planner);
+
+    snek_planner_free(planner);
+    free(engine);
+    return true;
+}
+
+// Run length encode bytes, returning the encoded size.
+// A control byte under 128 is followed by that many plus one bytes copied as they are, otherwise the next byte repeats the control byte minus 125 times.
+// The output must have room for the input size plus one byte for every 128.
+size_t snek_trajectory_pack(const uint8_t* input, size_t size, uint8_t* output) {
+    size_t in = 0;
+    size_t out = 0;
+    while (in < size) {
+        // Store runs of three bytes or more as one repeated byte.
+        size_t run = 1;
+        while (in + run < size && run < 130 && input[in + run] == input[in]) {
+            run++;
+        }
+        if (run >= 3) {
+            output[out++] = 125 + run;
+            output[out++] = input[in];
+            in += run;
+            continue;
+        }
+
+        // Otherwise copy bytes until the next run of three.
+        size_t literal = 0;
+        while (in + literal < size && literal < 128) {
+            if (in + literal + 2 < size && input[in + literal] == input[in + literal + 1] && input[in + literal] == input[in + literal + 2]) {
+                break;
+            }
+            literal++;
+        }
+        output[out++] = literal - 1;
+        memcpy(output + out, input + in, literal);
+        out += literal;
+        in += literal;
+    }
+    return out;
+}
 
-        case RIGHT:
-            if (snek->head->column + 1 >= MAP_COLUMNS-1) {
+// Decode run length encoded bytes into exactly the passed in output size.
+// Return true on success, and false if the encoded bytes are corrupt.
+bool snek_trajectory_unpack(const uint8_t* input, size_t size, uint8_t* output, size_t output_size) {
+    size_t in = 0;
+    size_t out = 0;
+    while (in < size) {
+        uint8_t control = input[in++];
+        if (control < 128) {
+            size_t literal = control + 1;
+            if (in + literal > size || out + literal > output_size) {
                 return false;
             }
-            new_snek_entity = snek_entity_new(snek->head->row, snek->head->column + 1);
-            break;
+            memcpy(output + out, input + in, literal);
+            in += literal;
+            out += literal;
+        } else {
+            size_t run = control - 125;
+            if (in >= size || out + run > output_size) {
+                return false;
+            }
+            memset(output + out, input[in++], run);
+            out += run;
+        }
     }
+    return out == output_size;
+}
 
-    // If there was a failure to return a pointer to a new snek entity head, return false.
-    if (new_snek_entity == NULL) {
-        printf("snek_update(): Failed to create a new snek entity for the updated snek entity. Returning false.\n");
+// Return true if a column with values of the passed in size is grouped by byte when encoded.
+// Small values like ticks and scores change in their low byte every row, so grouping their bytes gives runs of unchanged high bytes.
+// Tile maps are left in rows, as each row already only differs from the last in a few bytes.
+bool snek_trajectory_grouped(uint32_t value_size) {
+    return value_size <= 8;
+}
+
+// Encode a column of a chunk, taking each byte's difference from the same byte of the row before so unchanged bytes form long runs.
+// Return the encoded size.
+size_t snek_trajectory_encode(const uint8_t* column, uint32_t rows, uint32_t value_size, uint8_t* scratch, uint8_t* output) {
+    if (snek_trajectory_grouped(value_size) == false) {
+        memcpy(scratch, column, value_size);
+        for (size_t i = value_size; i < (size_t)rows * value_size; i++) {
+            scratch[i] = column[i] - column[i - value_size];
+        }
+        return snek_trajectory_pack(scratch, (size_t)rows * value_size, output);
+    }
+
+    for (uint32_t b = 0; b < value_size; b++) {
+        uint8_t previous = 0;
+        for (uint32_t i = 0; i < rows; i++) {
+            uint8_t value = column[(size_t)i * value_size + b];
+            scratch[(size_t)b * rows + i] = value - previous;
+            previous = value;
+        }
+    }
+    return snek_trajectory_pack(scratch, (size_t)rows * value_size, output);
+}
+
+// Decode a column encoded by snek_trajectory_encode().
+// Return true on success, and false if the column is corrupt.
+bool snek_trajectory_decode(const uint8_t* input, size_t size, uint32_t rows, uint32_t value_size, uint8_t* scratch, uint8_t* column) {
+    if (snek_trajectory_unpack(input, size, scratch, (size_t)rows * value_size) == false) {
         return false;
     }
+    if (snek_trajectory_grouped(value_size) == false) {
+        memcpy(column, scratch, value_size);
+        for (size_t i = value_size; i < (size_t)rows * value_size; i++) {
+            column[i] = scratch[i] + column[i - value_size];
+        }
+        return true;
+    }
 
-    // Check to see if the snek entity consumed a food entity that round.
-    // If so, set a flag that indicates it did and find a new location to spawn the food.
-    bool food_consumed = false;
-    if (new_snek_entity->row == snek->food_row && new_snek_entity->column == snek->food_column) {
-        food_consumed = true;
+    for (uint32_t b = 0; b < value_size; b++) {
+        uint8_t previous = 0;
+        for (uint32_t i = 0; i < rows; i++) {
+            previous += scratch[(size_t)b * rows + i];
+            column[(size_t)i * value_size + b] = previous;
+        }
     }
+    return true;
+}
 
-    // Copy the nodes from the snek entity that existed prior to updating position to the new snek entity
-    // Leave out the tail node unless food has been consumed.
-    // Since the head has already been updated, that means that copying the rest of the nodes from the old one will put them in the correct positions for the new snek entity, and copying the last node from the old snek entity will have the effect of growing the new snek in the right place.
-    
-    struct snek_entity* temp = snek->head;
-    while (temp != NULL) {
-        // Tail node check. Exit the loop if food has not been consumed and it is on the tail node.
-        if (temp->next == NULL && food_consumed == false) {
-            break;
+// Return the size of a column padded so the column after it is aligned.
+uint64_t snek_trajectory_align(uint64_t size) {
+    return (size + TRAJECTORY_ALIGNMENT - 1) / TRAJECTORY_ALIGNMENT * TRAJECTORY_ALIGNMENT;
+}
+
+// Encode and write a chunk to a trajectory dataset file, and add it to the index.
+// This runs on the writer thread, or on the recording thread if there is no writer thread.
+// Return true on success, and false on failure.
+bool snek_trajectory_write_chunk(struct snek_trajectory_writer* writer, struct snek_trajectory_chunk* chunk) {
+    struct snek_trajectory_chunk_header header = {0};
+    header.rows = chunk->rows;
+    header.flags = writer->flags;
+
+    uint64_t size = snek_trajectory_align(sizeof(struct snek_trajectory_chunk_header));
+    for (int32_t i = 0; i < TRAJECTORY_COLUMNS; i++) {
+        if (i == TRAJECTORY_MAP_COLUMN && (writer->flags & TRAJECTORY_MAP) == 0) {
+            continue;
         }
 
-        // Append the old snek node to the new snek entity. Return from function on failure.
-        if (snek_entity_append(new_snek_entity, temp->row, temp->column) == false) {
-            printf("snek_update(): Failed to append new node to the new snek. Returning false.\n");
-            snek_entity_free(new_snek_entity);
+        uint64_t column_size = (uint64_t)chunk->rows * snek_trajectory_column_sizes[i];
+        uint8_t* output = writer->output + size;
+        if ((writer->flags & TRAJECTORY_COMPRESSED) != 0) {
+            column_size = snek_trajectory_encode(chunk->columns[i], chunk->rows, snek_trajectory_column_sizes[i], writer->scratch, output);
+        } else {
+            memcpy(output, chunk->columns[i], column_size);
+        }
+        memset(output + column_size, 0, snek_trajectory_align(column_size) - column_size);
+
+        header.column_offset[i] = size;
+        header.column_size[i] = column_size;
+        writer->raw_bytes += (uint64_t)chunk->rows * snek_trajectory_column_sizes[i];
+        writer->encoded_bytes += column_size;
+        size += snek_trajectory_align(column_size);
+    }
+    header.size = size;
+    memcpy(writer->output, &header, sizeof(struct snek_trajectory_chunk_header));
+
+    if (writer->chunk_count == writer->index_capacity) {
+        uint64_t capacity = writer->index_capacity > 0 ? writer->index_capacity * 2 : 64;
+        uint64_t* index = (uint64_t*) realloc(writer->index, capacity * sizeof(uint64_t));
+        if (index == NULL) {
+            printf("snek_trajectory_write_chunk(): Failed to allocate memory for chunk index. Returning false.\n");
             return false;
         }
+        writer->index = index;
+        writer->index_capacity = capacity;
+    }
+
+    if (fwrite(writer->output, 1, size, writer->file) != size) {
+        printf("snek_trajectory_write_chunk(): Failed to write chunk. Returning false.\n");
+        return false;
+    }
+    writer->index[writer->chunk_count] = writer->offset;
+    writer->chunk_count++;
+    writer->offset += size;
+    return true;
+}
+
+// Run the writer thread, writing each chunk handed to it until told to quit.
+int snek_trajectory_thread(void* data) {
+    struct snek_trajectory_writer* writer = (struct snek_trajectory_writer*) data;
+
+    SDL_LockMutex(writer->mutex);
+    while (true) {
+        while (writer->pending == NULL && writer->quit == false) {
+            SDL_CondWait(writer->condition, writer->mutex);
+        }
+        if (writer->pending == NULL) {
+            break;
+        }
+
+        struct snek_trajectory_chunk* chunk = writer->pending;
+        SDL_UnlockMutex(writer->mutex);
+        bool written = snek_trajectory_write_chunk(writer, chunk);
+        SDL_LockMutex(writer->mutex);
+
+        if (written == false) {
+            writer->failed = true;
+        }
+        chunk->rows = 0;
+        writer->pending = NULL;
+        SDL_CondSignal(writer->condition);
+    }
+    SDL_UnlockMutex(writer->mutex);
+
+    return 0;
+}
+
+// Free a trajectory writer and its buffers, without finishing its file.
+void snek_trajectory_free(struct snek_trajectory_writer* writer) {
+    if (writer == NULL) {
+        return;
+    }
+    for (int32_t i = 0; i < 2; i++) {
+        for (int32_t j = 0; j < TRAJECTORY_COLUMNS; j++) {
+            free(writer->chunks[i].columns[j]);
+        }
+    }
+    SDL_DestroyCond(writer->condition);
+    SDL_DestroyMutex(writer->mutex);
+    free(writer->scratch);
+    free(writer->output);
+    free(writer->index);
+    if (writer->file != NULL) {
+        fclose(writer->file);
+    }
+    free(writer);
+}
+
+// Create a trajectory writer for a new dataset file, with the passed in flags to store the tile map or compress.
+// Return a pointer on success, and NULL on failure.
+struct snek_trajectory_writer* snek_trajectory_new(const char* path, uint32_t flags) {
+    struct snek_trajectory_writer* writer = (struct snek_trajectory_writer*) calloc(1, sizeof(struct snek_trajectory_writer));
+    if (writer == NULL) {
+        printf("snek_trajectory_new(): Failed to allocate memory for trajectory writer. Returning NULL.\n");
+        return NULL;
+    }
+    writer->flags = flags;
+
+    // Allocate both chunks and enough room to encode one, which can grow by one byte for every 128 plus alignment.
+    bool allocated = true;
+    uint64_t row_size = 0;
+    for (int32_t i = 0; i < TRAJECTORY_COLUMNS; i++) {
+        if (i == TRAJECTORY_MAP_COLUMN && (flags & TRAJECTORY_MAP) == 0) {
+            continue;
+        }
+        for (int32_t j = 0; j < 2; j++) {
+            writer->chunks[j].columns[i] = (uint8_t*) malloc((size_t)TRAJECTORY_CHUNK_ROWS * snek_trajectory_column_sizes[i]);
+            allocated = allocated && writer->chunks[j].columns[i] != NULL;
+        }
+        row_size += snek_trajectory_column_sizes[i];
+    }
+    uint64_t chunk_size = row_size * TRAJECTORY_CHUNK_ROWS;
+    writer->scratch = (uint8_t*) malloc(TRAJECTORY_MAP_SIZE * (size_t)TRAJECTORY_CHUNK_ROWS);
+    writer->output = (uint8_t*) malloc(sizeof(struct snek_trajectory_chunk_header) + chunk_size + chunk_size / 128 + TRAJECTORY_COLUMNS * (TRAJECTORY_ALIGNMENT + 1) + TRAJECTORY_ALIGNMENT);
+    writer->mutex = SDL_CreateMutex();
+    writer->condition = SDL_CreateCond();
+    if (allocated == false || writer->scratch == NULL || writer->output == NULL || writer->mutex == NULL || writer->condition == NULL) {
+        printf("snek_trajectory_new(): Failed to allocate trajectory chunks. Returning NULL.\n");
+        snek_trajectory_free(writer);
+        return NULL;
+    }
+
+    writer->file = fopen(path, "wb");
+    if (writer->file == NULL) {
+        printf("snek_trajectory_new(): Failed to open %s for writing. Returning NULL.\n", path);
+        snek_trajectory_free(writer);
+        return NULL;
+    }
+
+    // Leave room for the header, which is filled in once the dataset is finished.
+    writer->offset = snek_trajectory_align(sizeof(struct snek_trajectory_header));
+    uint8_t padding[TRAJECTORY_ALIGNMENT + sizeof(struct snek_trajectory_header)] = {0};
+    if (fwrite(padding, 1, writer->offset, writer->file) != writer->offset) {
+        printf("snek_trajectory_new(): Failed to write header to %s. Returning NULL.\n", path);
+        snek_trajectory_free(writer);
+        return NULL;
+    }
+
+    // Pack the level's tiles, two to a byte.
+    for (int32_t i = 0; i < MAP_ROWS * MAP_COLUMNS; i++) {
+        writer->map_template[i / 2] |= snek_level.tiles[i / MAP_COLUMNS][i % MAP_COLUMNS] << ((i % 2) * 4);
+    }
+
+    // Write chunks on the recording thread if the writer thread cannot be created.
+    writer->thread = SDL_CreateThread(snek_trajectory_thread, "snek_trajectory", writer);
+    if (writer->thread == NULL) {
+        printf("snek_trajectory_new(): Failed to create writer thread. SDL_GetError(): %s. Writing on the recording thread.\n", SDL_GetError());
+    }
+
+    return writer;
+}
+
+// Hand the chunk being filled to the writer thread and start filling the other one.
+// This only waits if the writer thread is still writing the other chunk.
+void snek_trajectory_submit(struct snek_trajectory_writer* writer) {
+    struct snek_trajectory_chunk* chunk = &writer->chunks[writer->filling];
+    if (chunk->rows == 0) {
+        return;
+    }
+    writer->row_count += chunk->rows;
+
+    if (writer->thread == NULL) {
+        if (snek_trajectory_write_chunk(writer, chunk) == false) {
+            writer->failed = true;
+        }
+        chunk->rows = 0;
+        return;
+    }
+
+    uint64_t start_time = SDL_GetPerformanceCounter();
+    SDL_LockMutex(writer->mutex);
+    while (writer->pending != NULL) {
+        SDL_CondWait(writer->condition, writer->mutex);
+    }
+    writer->pending = chunk;
+    SDL_CondSignal(writer->condition);
+    SDL_UnlockMutex(writer->mutex);
+    writer->stall_time += SDL_GetPerformanceCounter() - start_time;
+
+    writer->filling = 1 - writer->filling;
+}
+
+// Add a row to a trajectory dataset for the state of a headless game and the direction chosen in it.
+void snek_trajectory_record(struct snek_trajectory_writer* writer, struct snek_engine* engine, uint32_t game, uint32_t tick, uint8_t direction) {
+    struct snek_trajectory_chunk* chunk = &writer->chunks[writer->filling];
+    uint32_t row = chunk->rows;
+    uint16_t score = engine->score;
+
+    memcpy(chunk->columns[0] + row * 4, &game, 4);
+    memcpy(chunk->columns[1] + row * 4, &tick, 4);
+    chunk->columns[2][row] = direction;
+    chunk->columns[3][row] = engine->body_row[engine->head_index];
+    chunk->columns[4][row] = engine->body_column[engine->head_index];
+    chunk->columns[5][row] = engine->food_row;
+    chunk->columns[6][row] = engine->food_column;
+    memcpy(chunk->columns[7] + row * 2, &score, 2);
+
+    // Draw the entities over the level's packed tiles, in the same colours as snek_update().
+    if ((writer->flags & TRAJECTORY_MAP) != 0) {
+        uint8_t* map = chunk->columns[TRAJECTORY_MAP_COLUMN] + (size_t)row * TRAJECTORY_MAP_SIZE;
+        memcpy(map, writer->map_template, TRAJECTORY_MAP_SIZE);
+        for (int32_t i = engine->length - 1; i >= -1; i--) {
+            int32_t tile = i > 0 ? GREEN : i == 0 ? HEAD : RED;
+            int32_t index = engine->food_row * MAP_COLUMNS + engine->food_column;
+            if (i >= 0) {
+                int32_t body_index = (engine->head_index - i + MAP_ROWS * MAP_COLUMNS) % (MAP_ROWS * MAP_COLUMNS);
+                index = engine->body_row[body_index] * MAP_COLUMNS + engine->body_column[body_index];
+            }
+            map[index / 2] = (map[index / 2] & (0xF0 >> ((index % 2) * 4))) | (tile << ((index % 2) * 4));
+        }
+    }
 
-        // Traverse through the entity.
-        temp = temp->next;
+    chunk->rows++;
+    if (chunk->rows == TRAJECTORY_CHUNK_ROWS) {
+        snek_trajectory_submit(writer);
     }
+}
 
-    // If copying values to new snek entity occurs successfully, free old snek entity and set the snek entity pointer to the new updated one.
-    snek_entity_free(snek->head);
-    snek->head = new_snek_entity;
+// Finish a trajectory dataset, writing the last chunk, the chunk index and the header, then free the writer.
+// Return true on success, and false if anything failed to write.
+bool snek_trajectory_close(struct snek_trajectory_writer* writer) {
+    snek_trajectory_submit(writer);
+    if (writer->thread != NULL) {
+        SDL_LockMutex(writer->mutex);
+        writer->quit = true;
+        SDL_CondSignal(writer->condition);
+        SDL_UnlockMutex(writer->mutex);
+        SDL_WaitThread(writer->thread, NULL);
+        writer->thread = NULL;
+    }
 
-    // Check for snek entity head to body node collisions. If there are any nodes equal to the head, return false.
-    // Traverse the new snek entity to find this out.
-    // There is no error to be reported since this is not abnormal behaviour, it is an expected feature, a snek entity should not be allowed to eat itself. Hence the lack of printf().
-    temp = snek->head;
-    while (temp != NULL) {
-        if (temp->row == snek->head->row && temp->column == snek->head->column && temp != snek->head) {
-            return false;
-        }
-        temp = temp->next;
+    struct snek_trajectory_header header = {0};
+    memcpy(header.magic, TRAJECTORY_MAGIC, 8);
+    header.version = TRAJECTORY_VERSION;
+    header.flags = writer->flags;
+    header.chunk_rows = TRAJECTORY_CHUNK_ROWS;
+    header.map_rows = MAP_ROWS;
+    header.map_columns = MAP_COLUMNS;
+    header.map_size = TRAJECTORY_MAP_SIZE;
+    header.chunk_count = writer->chunk_count;
+    header.row_count = writer->row_count;
+    header.index_offset = writer->offset;
+
+    bool written = writer->failed == false;
+    written = written && fwrite(writer->index, sizeof(uint64_t), writer->chunk_count, writer->file) == writer->chunk_count;
+    written = written && fseek(writer->file, 0, SEEK_SET) == 0;
+    written = written && fwrite(&header, sizeof(struct snek_trajectory_header), 1, writer->file) == 1;
+    written = fclose(writer->file) == 0 && written;
+    writer->file = NULL;
+    if (written == false) {
+        printf("snek_trajectory_close(): Failed to finish trajectory dataset. Returning false.\n");
     }
 
-    // Find a new food location that exists outside the snek entity:
-    // This is only if the food is consumed.
-    // Add a point to the score.
-    if (food_consumed == 1) {
-        if (snek_food_entity_spawn() == false) {
-            printf("snek_update(): snek_food_entity_spawn returned false when attempting to find new food location to spawn. Return false.\n");
-            return false;
+    snek_trajectory_free(writer);
+    return written;
+}
+
+// Record headless games played by the cheap bot to a trajectory dataset, starting from the passed in seed.
+// Print the ticks recorded per second, the size of the dataset and time spent waiting for the writer thread.
+// Return true on success, and false on failure.
+bool snek_record(int32_t games, const char* path, uint64_t seed, uint32_t flags) {
+    struct snek_engine* engine = (struct snek_engine*) malloc(sizeof(struct snek_engine));
+    struct snek_trajectory_writer* writer = snek_trajectory_new(path, flags);
+    if (engine == NULL || writer == NULL) {
+        printf("snek_record(): Failed to create headless game or trajectory writer. Returning false.\n");
+        free(engine);
+        snek_trajectory_free(writer);
+        return false;
+    }
+
+    uint64_t random_state = snek_random_seed(~seed);
+    uint64_t start_time = SDL_GetPerformanceCounter();
+    for (int32_t game = 0; game < games; game++) {
+        snek_engine_init(engine, seed + game);
+
+        uint32_t tick = 0;
+        while (engine->status == MID_GAME && tick < TRAJECTORY_MAX_TICKS) {
+            uint8_t direction = snek_engine_greedy_direction(engine, &random_state);
+            snek_trajectory_record(writer, engine, game, tick, direction);
+            engine->direction = direction;
+            snek_engine_update(engine);
+            tick++;
         }
-        snek->score++;
     }
 
-    // Copy the snek and food entities to the tile map:
-    temp = snek->head;
-    while (temp != NULL) {
-        snek->map[temp->row][temp->column] = GREEN;
-        temp = temp->next;
+    uint64_t row_count = writer->row_count + writer->chunks[writer->filling].rows;
+    uint64_t stall_time = writer->stall_time;
+    bool closed = snek_trajectory_close(writer);
+    double seconds = (double)(SDL_GetPerformanceCounter() - start_time) / (double)SDL_GetPerformanceFrequency();
+    free(engine);
+    if (closed == false) {
+        return false;
     }
-    snek->map[snek->head->row][snek->head->column] = HEAD;
-    snek->map[snek->food_row][snek->food_column] = RED;
 
-    // Return true since all went well.
+    printf("Recorded %llu ticks over %d games in %.2f seconds (%.0f ticks/s), waiting %.3f seconds for the writer.\n",
+        (unsigned long long)row_count, games, seconds, seconds > 0 ? row_count / seconds : 0.0, (double)stall_time / (double)SDL_GetPerformanceFrequency());
     return true;
 }
 
-// Update the snek entity's direction based on input:
-// Return true on success, and false on failure.
-bool snek_input() {
-    // Return false if the snek global variable pointer does not point to a valid memory location on heap.
-    if (snek == NULL) {
-        printf("snek_input(): Snek global variable pointer is NULL. Returning false.\n");
+// Map a trajectory dataset and check every chunk, decoding compressed columns.
+// Print the number of rows, games and bytes, and the mean score over all rows.
+// Return true if the dataset is valid, and false otherwise.
+bool snek_trajectory_info(const char* path) {
+    int fd = open(path, O_RDONLY);
+    struct stat file_status;
+    if (fd < 0 || fstat(fd, &file_status) != 0 || file_status.st_size < (off_t)sizeof(struct snek_trajectory_header)) {
+        printf("snek_trajectory_info(): Failed to open trajectory dataset %s. Returning false.\n", path);
+        if (fd >= 0) {
+            close(fd);
+        }
+        return false;
+    }
+    uint8_t* data = (uint8_t*) mmap(NULL, file_status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        printf("snek_trajectory_info(): Failed to map trajectory dataset %s. Returning false.\n", path);
         return false;
     }
 
-    // Set the direction based on recieved keypress
-    switch (snek->event.key.keysym.sym) {
-        case SDLK_w:
-            if (snek->direction != DOWN || snek->status == START_MENU) {
-                snek->direction = UP;
+    uint64_t size = file_status.st_size;
+    const struct snek_trajectory_header* header = (const struct snek_trajectory_header*) data;
+    bool valid = memcmp(header->magic, TRAJECTORY_MAGIC, 8) == 0 && header->version == TRAJECTORY_VERSION && header->chunk_rows <= TRAJECTORY_CHUNK_ROWS
+        && header->map_size == TRAJECTORY_MAP_SIZE && header->index_offset <= size && header->index_offset % TRAJECTORY_ALIGNMENT == 0 && header->chunk_count <= (size - header->index_offset) / sizeof(uint64_t);
+
+    // Decode compressed columns into buffers the size of one chunk's column.
+    uint8_t* column = (uint8_t*) malloc((size_t)TRAJECTORY_CHUNK_ROWS * TRAJECTORY_MAP_SIZE);
+    uint8_t* scratch = (uint8_t*) malloc((size_t)TRAJECTORY_CHUNK_ROWS * TRAJECTORY_MAP_SIZE);
+    valid = valid && column != NULL && scratch != NULL;
+
+    uint64_t rows = 0;
+    uint64_t games = 0;
+    uint64_t total_score = 0;
+    const uint64_t* index = valid ? (const uint64_t*) (data + header->index_offset) : NULL;
+    for (uint64_t c = 0; valid == true && c < header->chunk_count; c++) {
+        const struct snek_trajectory_chunk_header* chunk = (const struct snek_trajectory_chunk_header*) (data + index[c]);
+        valid = index[c] % TRAJECTORY_ALIGNMENT == 0 && index[c] + sizeof(struct snek_trajectory_chunk_header) <= size
+            && chunk->size <= size - index[c] && chunk->rows <= header->chunk_rows;
+        for (int32_t i = 0; i < TRAJECTORY_COLUMNS && valid == true; i++) {
+            if (i == TRAJECTORY_MAP_COLUMN && (chunk->flags & TRAJECTORY_MAP) == 0) {
+                continue;
             }
-            break;
-        
-        case SDLK_UP:
-            if (snek->direction != DOWN || snek->status == START_MENU) {
-                snek->direction = UP;
+            valid = chunk->column_offset[i] <= chunk->size && chunk->column_size[i] <= chunk->size - chunk->column_offset[i];
+            const uint8_t* values = (const uint8_t*) chunk + chunk->column_offset[i];
+            if (valid == true && (chunk->flags & TRAJECTORY_COMPRESSED) != 0) {
+                valid = snek_trajectory_decode(values, chunk->column_size[i], chunk->rows, snek_trajectory_column_sizes[i], scratch, column);
+                values = column;
+            } else if (valid == true) {
+                valid = chunk->column_size[i] == (uint64_t)chunk->rows * snek_trajectory_column_sizes[i];
             }
-            break;
 
-        case SDLK_s:
-            if (snek->direction != UP || snek->status == START_MENU) {
-                snek->direction = DOWN;
+            // Count games by the rows where the tick goes back to zero, and add up the scores.
+            for (uint32_t row = 0; valid == true && row < chunk->rows; row++) {
+                if (i == 1) {
+                    uint32_t tick = 0;
+                    memcpy(&tick, values + row * 4, 4);
+                    games += tick == 0;
+                } else if (i == 7) {
+                    uint16_t score = 0;
+                    memcpy(&score, values + row * 2, 2);
+                    total_score += score;
+                }
             }
-            break;
+        }
+        rows += chunk->rows;
+    }
+    valid = valid && rows == header->row_count;
+
+    if (valid == true) {
+        printf("%s: %llu rows over %llu games in %llu chunks, %llu bytes%s%s. Mean score per row %.2f.\n", path,
+            (unsigned long long)rows, (unsigned long long)games, (unsigned long long)header->chunk_count, (unsigned long long)size,
+            (header->flags & TRAJECTORY_MAP) != 0 ? ", with tile maps" : "", (header->flags & TRAJECTORY_COMPRESSED) != 0 ? ", compressed" : "",
+            rows > 0 ? (double)total_score / rows : 0.0);
+    } else {
+        printf("snek_trajectory_info(): %s is not a valid trajectory dataset. Returning false.\n", path);
+    }
 
-        case SDLK_DOWN:
-            if (snek->direction != UP || snek->status == START_MENU) {
-                snek->direction = DOWN;
-            }
-            break;
+    free(column);
+    free(scratch);
+    munmap(data, size);
+    return valid;
+}
 
-        case SDLK_d:
-            if (snek->direction != LEFT || snek->status == START_MENU) {
-                snek->direction = RIGHT;
-            }
-            break;
-        
-        case SDLK_RIGHT:
-            if (snek->direction != LEFT || snek->status == START_MENU) {
-                snek->direction = RIGHT;
-            }
-            break;
+// Return the direction for a sample bot to turn in, from a snapshot of the board.
+// Take the step that gets closest to the food without running into a wall or the snek entity, otherwise keep going.
+int32_t snek_channel_bot_direction(struct snek_channel_board* board) {
+    int32_t row_steps[4] = {-1, 1, 0, 0};
+    int32_t column_steps[4] = {0, 0, -1, 1};
+    int32_t best_direction = board->direction;
+    int32_t best_distance = MAP_ROWS + MAP_COLUMNS;
+
+    for (int32_t i = 0; i < 4; i++) {
+        int32_t row = board->head_row + row_steps[i];
+        int32_t column = board->head_column + column_steps[i];
+        if (i == (board->direction ^ 1) || (board->map[row][column] != BLACK && board->map[row][column] != RED)) {
+            continue;
+        }
+        int32_t distance = abs(row - board->food_row) + abs(column - board->food_column);
+        if (distance < best_distance) {
+            best_distance = distance;
+            best_direction = i;
+        }
+    }
+    return best_direction;
+}
 
-        case SDLK_a:
-            if (snek->direction != RIGHT || snek->status == START_MENU) {
-                snek->direction = LEFT;
-            }
-            break;
-        
-        case SDLK_LEFT:
-            if (snek->direction != RIGHT || snek->status == START_MENU) {
-                snek->direction = LEFT;
+// Run a sample bot attached to the control channel with the passed in name, answering every tick of the game until it quits.
+// The bot spins waiting for each board instead of sleeping, so it answers as soon as the board is published.
+// It yields every so often, so it still gets answers in quickly when it shares a core with the game.
+// Return true on success, and false on failure.
+bool snek_channel_bot(const char* name) {
+    struct snek_channel* channel = snek_channel_open(name, false);
+    if (channel == NULL) {
+        printf("snek_channel_bot(): snek_channel_open() failed. Start the game with --channel %s first. Returning false.\n", name);
+        return false;
+    }
+
+    struct snek_channel_board board;
+    uint64_t last_sequence = 0;
+    int32_t spins = 0;
+    while (true) {
+        // Only copy the board once its sequence has changed, yielding the core now and then in case the game is waiting for it.
+        if (atomic_load_explicit(&channel->sequence, memory_order_relaxed) == last_sequence) {
+            if (++spins == CHANNEL_SPIN_LIMIT) {
+                spins = 0;
+                sched_yield();
             }
+            continue;
+        }
+
+        uint64_t sequence = snek_channel_read(channel, &board);
+        if (board.status == QUIT_LOOP) {
             break;
+        }
+        last_sequence = sequence;
+        if (board.status != MID_GAME) {
+            continue;
+        }
+
+        uint64_t command = ((board.tick + 1) << 8) | snek_channel_bot_direction(&board);
+        atomic_store_explicit(&channel->command, command, memory_order_release);
     }
 
-    // Return true on success.
+    snek_channel_close(channel, NULL);
     return true;
 }
 
-// Run the main program loop.
-// Return true on time to quit, false to continue
-void snek_loop() {
-    // Return false if the snek global variable pointer does not point to a valid memory location on heap.
-    if (snek == NULL) {
-        printf("snek_loop(): Snek global variable pointer is NULL. Quitting.\n");
-        return;
+// Evaluate a plugin by playing headless games with it, holding it to the deadline of the passed in difficulty.
+// Print the score of each game, the plugin's decision latency percentiles and how many ticks it missed.
+// Return true on success, and false on failure.
+bool snek_plugin_evaluate(const char* path, int32_t games, uint64_t seed, int32_t difficulty) {
+    struct snek_engine* engine = (struct snek_engine*) malloc(sizeof(struct snek_engine));
+    struct snek_plugin* plugin = snek_plugin_new(path);
+    if (engine == NULL || plugin == NULL) {
+        printf("snek_plugin_evaluate(): Failed to create headless game or load plugin. Returning false.\n");
+        free(engine);
+        snek_plugin_free(plugin);
+        return false;
     }
 
-    // Save some CPU time by pausing for a little.
-    SDL_Delay(2);
+    int64_t total_score = 0;
+    for (int32_t game = 0; game < games; game++) {
+        snek_engine_init(engine, seed + game);
 
-    // Run the loop program procedure for before the game starts.
-    // Start the game once the user is ready.
-    // Scan for input until the user signals they're able to play, then update the state.
-    if (snek->status == START_MENU) {
-        // Render to the screen:
-        snek_render_menu();
+        int32_t ticks = 0;
+        while (engine->status == MID_GAME && ticks < FUZZ_MAX_TICKS) {
+            snek_plugin_start(plugin, engine, ticks, snek_plugin_budget(difficulty));
+            engine->direction = snek_plugin_finish(plugin, engine->direction, true);
+            snek_engine_update(engine);
+            ticks++;
+        }
 
-        // Poll for input.
-        while (SDL_PollEvent(&snek->event) != 0) {
-            if (snek->event.type == SDL_QUIT) {
-                snek->status = QUIT_LOOP;
-                return;
-            }
+        printf("Game %d: score %d after %d ticks.\n", game, engine->score, ticks);
+        total_score += engine->score;
+    }
 
-            if (snek->event.type == SDL_KEYDOWN) {
-                // Update snek direction and proceed to game.
-                snek_input();
-                snek->status = MID_GAME;
+    // Include the plugin's last decision in its latency even if it was too late for the last game.
+    printf("Mean score over %d games: %.2f\n", games, games > 0 ? (double)total_score / games : 0.0);
+    snek_plugin_wait(plugin);
+    snek_plugin_print(plugin);
 
-                // If a difficulty option key is pressed, update difficulty and don't progress to game
-                // Scan again for more inputs
-                switch (snek->event.key.keysym.sym) {
-                    case SDLK_e:
-                        snek->difficulty = EASY;
-                        snek->status = START_MENU;
-                        break;
+    snek_plugin_free(plugin);
+    free(engine);
+    return true;
+}
 
-                    case SDLK_r:
-                        snek->difficulty = REGULAR;
-                        snek->status = START_MENU;
-                        break;
+// Benchmark the round trip through the control channel with a sample bot in a separate process.
+// A headless game publishes its board, then waits for the bot's direction for that tick before updating, restarting whenever a game ends.
+// Print latency percentiles from publishing the board to taking the bot's direction.
+// The bot needs a process of its own, so this is not available on the web.
+// Return true on success, and false on failure.
+bool snek_channel_bench(int32_t ticks) {
+#ifdef __EMSCRIPTEN__
+    printf("snek_channel_bench(): Control channels are not available on the web. Returning false.\n");
+    return false;
+#else
+    char name[64];
+    snprintf(name, sizeof(name), "/snek_bench_%d", (int)getpid());
+
+    struct snek_channel* channel = snek_channel_open(name, true);
+    struct snek_engine* engine = (struct snek_engine*) malloc(sizeof(struct snek_engine));
+    uint64_t* samples = (uint64_t*) malloc(sizeof(uint64_t) * (ticks > 0 ? ticks : 1));
+    if (channel == NULL || engine == NULL || samples == NULL) {
+        printf("snek_channel_bench(): Failed to create channel, headless game or samples. Returning false.\n");
+        snek_channel_close(channel, name);
+        free(engine);
+        free(samples);
+        return false;
+    }
 
-                    case SDLK_q:
-                        snek->difficulty = HARD;
-                        snek->status = START_MENU;
-                        break;
-                }
+    pid_t bot = fork();
+    if (bot == 0) {
+        exit(snek_channel_bot(name) ? 0 : 1);
+    }
+    if (bot < 0) {
+        printf("snek_channel_bench(): Failed to start bot process. Returning false.\n");
+        snek_channel_close(channel, name);
+        free(engine);
+        free(samples);
+        return false;
+    }
+
+    uint64_t frequency = SDL_GetPerformanceFrequency();
+    int32_t games = 0;
+    int64_t total_score = 0;
+    int32_t completed = 0;
+    snek_engine_init(engine, 1);
+    for (; completed < ticks; completed++) {
+        // Publish the board, drawn the same way as snek_update() draws the tile map.
+        uint64_t start_time = SDL_GetPerformanceCounter();
+        snek_channel_publish_begin(channel);
+        struct snek_channel_board* board = &channel->board;
+        board->tick = completed;
+        board->status = MID_GAME;
+        board->direction = engine->direction;
+        board->score = engine->score;
+        board->head_row = engine->body_row[engine->head_index];
+        board->head_column = engine->body_column[engine->head_index];
+        board->food_row = engine->food_row;
+        board->food_column = engine->food_column;
+        snek_engine_draw(engine, board->map);
+        snek_channel_publish_end(channel);
+
+        // Wait for the bot to answer this tick, giving up if it takes more than a second.
+        uint64_t command = 0;
+        int32_t spins = 0;
+        while ((command >> 8) != (uint64_t)completed + 1 && SDL_GetPerformanceCounter() - start_time < frequency) {
+            command = atomic_load_explicit(&channel->command, memory_order_acquire);
+            if (++spins == CHANNEL_SPIN_LIMIT) {
+                spins = 0;
+                sched_yield();
             }
+        }
+        if ((command >> 8) != (uint64_t)completed + 1) {
+            printf("snek_channel_bench(): Bot did not answer tick %d within a second.\n", completed);
             break;
         }
+        atomic_store_explicit(&channel->command, 0, memory_order_relaxed);
+        samples[completed] = SDL_GetPerformanceCounter() - start_time;
+
+        engine->direction = command & 0xFF;
+        if (snek_engine_update(engine) == false) {
+            games++;
+            total_score += engine->score;
+            snek_engine_init(engine, games + 1);
+        }
     }
 
-    // Run the loop program procedure for the main gameplay:
-    if (snek->status == MID_GAME) {
-        //printf("I'm in the mid game\n");
-        // Poll for input.
-        while (SDL_PollEvent(&snek->event) != 0) {
-            if (snek->event.type == SDL_QUIT) {
-                snek->status = QUIT_LOOP;
-                return;
-            }
+    // Tell the bot to quit and wait for it.
+    snek_channel_publish_begin(channel);
+    channel->board.status = QUIT_LOOP;
+    snek_channel_publish_end(channel);
+    waitpid(bot, NULL, 0);
+    snek_channel_close(channel, name);
+
+    if (completed > 0) {
+        qsort(samples, completed, sizeof(uint64_t), snek_compare_samples);
+        double to_nanoseconds = 1000000000.0 / (double)frequency;
+        printf("Channel round trip over %d ticks: p50 %.0fns p90 %.0fns p99 %.0fns p99.9 %.0fns max %.0fns\n", completed,
+            samples[completed / 2] * to_nanoseconds, samples[(int64_t)completed * 90 / 100] * to_nanoseconds,
+            samples[(int64_t)completed * 99 / 100] * to_nanoseconds, samples[(int64_t)completed * 999 / 1000] * to_nanoseconds,
+            samples[completed - 1] * to_nanoseconds);
+        printf("The bot finished %d games with a mean score of %.2f.\n", games, games > 0 ? (double)total_score / games : 0.0);
+    }
 
-            if (snek->event.type == SDL_KEYDOWN) {
-                if (snek->event.key.keysym.sym == SDLK_p) {
-                    snek->status = PAUSE;
-                    break;
-                }
-                snek_input();
-            }
-            break;
-        }
+    free(engine);
+    free(samples);
+    return completed == ticks;
+#endif
+}
 
-        // Calculate time elapsed since last time this code was run.
-        // If it has been long enough, then update the snek and render to the screen the updated gameplay.
-        // Store time to calculate when to update entities and render world
-        // The number the difficulty is set to is actually the milliseconds in delay it takes between updates!
+int main(int argc, char* argv[]) {
+    // Time to first frame is measured from here, so it covers everything the program does before the menu is shown, including loading the font for it.
+    snek_launch_time = SDL_GetPerformanceCounter();
 
-        snek->current_time = SDL_GetTicks();
-        if (snek->current_time > snek->last_time + snek->difficulty) {
-            // Check to make sure the game is still won or not.
-            // If not, set status to game over
-            if (snek_update() == false) {
-                snek->status = GAME_OVER;
-            }
+    // The Zobrist keys and level are needed by every mode, so set them up first.
+    snek_zobrist_init();
+    if (snek_level_default() == false) {
+        printf("main(): snek_level_default() function returned false. Returning.\n");
+        return 1;
+    }
+
+    // Convert a text level into a level file if asked to.
+    if (argc >= 4 && strcmp(argv[1], "--level-build") == 0) {
+        bool converted = snek_level_convert(argv[2], argv[3]);
+        snek_level_close();
+        return converted ? 0 : 1;
+    }
+
+    // Run the sample bot against a game's control channel, or benchmark the channel with the sample bot.
+    if (argc >= 3 && strcmp(argv[1], "--channel-bot") == 0) {
+        return snek_channel_bot(argv[2]) ? 0 : 1;
+    }
 
-            // Render to the screen
-            snek_render();
+    if (argc >= 2 && strcmp(argv[1], "--channel-bench") == 0) {
+        return snek_channel_bench(argc >= 3 ? atoi(argv[2]) : CHANNEL_BENCH_TICKS) ? 0 : 1;
+    }
 
-            // Set value for last time since this function called so we can compare it to current time to check how long has passed since then.
-            snek->last_time = snek->current_time;
+    // Play on a level file instead of the default level if asked to, before any other options.
+    if (argc >= 3 && strcmp(argv[1], "--level") == 0) {
+        if (snek_level_load(argv[2]) == false) {
+            printf("main(): snek_level_load() function returned false. Returning.\n");
+            snek_level_close();
+            return 1;
         }
+        argc -= 2;
+        argv += 2;
     }
 
-    // Run the loop program procedure for the game over screen.
-    if (snek->status == GAME_OVER) {
-        // Render game over screen.
-        snek_render_game_over();
+    // Evaluate a plugin headless, with an optional seed and difficulty delay in milliseconds.
+    if (argc >= 4 && strcmp(argv[1], "--plugin-evaluate") == 0) {
+        uint64_t seed = argc >= 5 ? strtoull(argv[4], NULL, 10) : (uint64_t)time(0);
+        int32_t difficulty = argc >= 6 ? atoi(argv[5]) : REGULAR;
+        return snek_plugin_evaluate(argv[2], atoi(argv[3]), seed, difficulty) ? 0 : 1;
+    }
 
-        // Poll for input
-        while (SDL_PollEvent(&snek->event) != 0) {
-            if (snek->event.type == SDL_QUIT) {
-                snek->status = QUIT_LOOP;
-                return;
-            }
+    // Let a plugin play the game instead of the player if asked to.
+    const char* plugin_path = NULL;
+    if (argc >= 3 && strcmp(argv[1], "--plugin") == 0) {
+        plugin_path = argv[2];
+        argc -= 2;
+        argv += 2;
+    }
 
-            // On any key press, reset the game and go back to the start menu.
-            if (snek->event.type == SDL_KEYDOWN) {
-                snek_entity_free(snek->head);
-                snek->head = snek_entity_new(MAP_ROWS/2, MAP_COLUMNS/2);
-                snek_food_entity_spawn();
-                snek_map_init();
-                snek->score = 1;
-                snek->status = START_MENU;
-            }
-            break;
-        }
+    // Publish the game to bot processes on a shared memory control channel if asked to.
+    const char* channel_name = NULL;
+    if (argc >= 3 && strcmp(argv[1], "--channel") == 0) {
+        channel_name = argv[2];
+        argc -= 2;
+        argv += 2;
     }
 
-    if (snek->status == PAUSE) {
-        // Scan for input and resume when any key is pressed.
-        while (SDL_PollEvent(&snek->event) != 0) {
-            if (snek->event.type == SDL_QUIT) {
-                snek->status = QUIT_LOOP;
-                return;
-            }
+    // A plugin decides every update itself, so bots on a control channel would never be listened to.
+    if (plugin_path != NULL && channel_name != NULL) {
+        printf("main(): --plugin and --channel cannot be used together, as only one of them can control the snek entity. Returning.\n");
+        snek_level_close();
+        return 1;
+    }
 
-            if (snek->event.type == SDL_KEYDOWN) {
-                if (snek->event.key.keysym.sym == SDLK_p) {
-                    snek->status = MID_GAME;
-                    break;
-                }
+    // The spectator wall's boards are played by their own bots, so there is no game to publish to bots.
+    bool spectating = argc >= 2 && strcmp(argv[1], "--spectate") == 0;
+    if (spectating == true && channel_name != NULL) {
+        printf("main(): --channel cannot be used with --spectate, as the spectator wall has no game for bots to control. Returning.\n");
+        snek_level_close();
+        return 1;
+    }
+    if (spectating == true && plugin_path != NULL) {
+        printf("main(): --plugin cannot be used with --spectate, as the spectator wall has no game for a plugin to control. Returning.\n");
+        snek_level_close();
+        return 1;
+    }
+
+    // Run the fuzzing harness or a replay instead of the game if asked to on the command line.
+    if (argc >= 3 && strcmp(argv[1], "--fuzz") == 0) {
+        uint64_t seed = argc >= 4 ? strtoull(argv[3], NULL, 10) : (uint64_t)time(0);
+        return snek_fuzz(strtoull(argv[2], NULL, 10), seed) ? 0 : 1;
+    }
+
+    if (argc >= 4 && strcmp(argv[1], "--replay") == 0) {
+        return snek_replay(strtoull(argv[2], NULL, 10), argv[3]) ? 0 : 1;
+    }
+
+    // Check that playing the game never allocates.
+    if (argc >= 2 && strcmp(argv[1], "--allocation-test") == 0) {
+        uint64_t ticks = argc >= 3 ? strtoull(argv[2], NULL, 10) : ALLOCATION_TEST_TICKS;
+        uint64_t seed = argc >= 4 ? strtoull(argv[3], NULL, 10) : (uint64_t)time(0);
+        return snek_allocation_test(ticks, seed) ? 0 : 1;
+    }
+
+    // Record games to a trajectory dataset, with an optional seed, then options to store tile maps and compress.
+    if (argc >= 4 && strcmp(argv[1], "--record") == 0) {
+        uint64_t seed = argc >= 5 ? strtoull(argv[4], NULL, 10) : (uint64_t)time(0);
+        uint32_t flags = 0;
+        for (int32_t i = 5; i < argc; i++) {
+            if (strcmp(argv[i], "map") == 0) {
+                flags |= TRAJECTORY_MAP;
+            } else if (strcmp(argv[i], "compress") == 0) {
+                flags |= TRAJECTORY_COMPRESSED;
             }
-            break;
         }
+        return snek_record(atoi(argv[2]), argv[3], seed, flags) ? 0 : 1;
+    }
+
+    if (argc >= 3 && strcmp(argv[1], "--trajectory-info") == 0) {
+        return snek_trajectory_info(argv[2]) ? 0 : 1;
+    }
+
+    // Evaluate the autopilot headless, with an optional seed and difficulty delay in milliseconds.
+    if (argc >= 3 && strcmp(argv[1], "--autopilot") == 0) {
+        uint64_t seed = argc >= 4 ? strtoull(argv[3], NULL, 10) : (uint64_t)time(0);
+        int32_t difficulty = argc >= 5 ? atoi(argv[4]) : REGULAR;
+        return snek_autopilot_evaluate(atoi(argv[2]), seed, difficulty) ? 0 : 1;
     }
-    return;
-}
 
-int main(void) {
     // Initialise the snek program.
     if (snek_init() == false) {
         printf("main(): snek_init() function returned false. Returning.\n");
         return 0;
     }
 
+    if (channel_name != NULL) {
+        snek->channel = snek_channel_open(channel_name, true);
+        if (snek->channel == NULL) {
+            printf("main(): snek_channel_open() function returned NULL. Returning.\n");
+            snek_quit();
+            return 0;
+        }
+        snek->channel_name = channel_name;
+        snek_channel_publish();
+    }
+
+    if (plugin_path != NULL) {
+        snek->plugin = snek_plugin_new(plugin_path);
+        if (snek->plugin == NULL) {
+            printf("main(): snek_plugin_new() function returned NULL. Returning.\n");
+            snek_quit();
+            return 0;
+        }
+    }
+
+    // Spectate a wall of bots instead of playing if asked to, with an optional number of boards and seed.
+    void (*loop)(void) = snek_loop;
+    if (argc >= 2 && strcmp(argv[1], "--spectate") == 0) {
+        int32_t board_count = argc >= 3 ? atoi(argv[2]) : SPECTATOR_DEFAULT_BOARDS;
+        uint64_t seed = argc >= 4 ? strtoull(argv[3], NULL, 10) : (uint64_t)time(0);
+        if (snek_spectator_init(board_count, seed) == false) {
+            printf("main(): snek_spectator_init() function returned false. Returning.\n");
+            snek_quit();
+            return 0;
+        }
+        loop = snek_spectator_loop;
+    }
+
     // Run the main program loop.
     // If the code is an emscripten/webassembly environment.
     #ifdef __EMSCRIPTEN__
-        emscripten_set_main_loop(snek_loop, 0, 1);
+        emscripten_set_main_loop(loop, 0, 1);
     #endif
 
     // On a traditional OS, run the loop function inside a while loop.
     while (snek->status != QUIT_LOOP) {
-        snek_loop();
+        loop();
     }
     
+    snek_spectator_free();
     snek_quit();
     return 0;
 }
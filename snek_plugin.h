@@ -0,0 +1,44 @@
+// The interface between snek and the controller plugins it loads from shared objects with --plugin.
+// Plugins only need this header, and are built with: gcc -shared -fPIC -o plugin.so plugin.c
+#ifndef SNEK_PLUGIN_H
+#define SNEK_PLUGIN_H
+
+#include <stdint.h>
+
+// Define constants for the directions a plugin returns:
+#define SNEK_PLUGIN_UP 0
+#define SNEK_PLUGIN_DOWN 1
+#define SNEK_PLUGIN_LEFT 2
+#define SNEK_PLUGIN_RIGHT 3
+
+// Define constants for the tiles on the board's map:
+// Empty tiles are black, the snek entity's body is green with its head marked, food is red and walls are grey.
+#define SNEK_PLUGIN_BLACK 0
+#define SNEK_PLUGIN_GREEN 1
+#define SNEK_PLUGIN_RED 2
+#define SNEK_PLUGIN_GREY 3
+#define SNEK_PLUGIN_HEAD 4
+
+// Create a data type for the read only view of the board a plugin is shown every tick.
+// The map is rows times columns tiles, one row after another, and the tick is how many updates the game has had.
+// The snek entity cannot turn straight back, so returning the opposite of its direction keeps it going the same way.
+struct snek_plugin_board {
+    uint64_t tick;
+    int32_t direction;
+    int32_t score;
+    int32_t head_row;
+    int32_t head_column;
+    int32_t food_row;
+    int32_t food_column;
+    int32_t rows;
+    int32_t columns;
+    const int32_t* map;
+};
+
+// Plugins export a function with this name and type, returning the direction to turn in for the board.
+// It is called on a thread of its own, and must not keep the board after returning.
+// If it does not return within the deadline for the tick, the snek entity keeps going in its current direction.
+#define SNEK_PLUGIN_DIRECTION_SYMBOL "snek_plugin_direction"
+typedef int32_t (*snek_plugin_direction_function)(const struct snek_plugin_board* board);
+
+#endif